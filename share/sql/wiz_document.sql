@@ -30,5 +30,6 @@ create table WIZ_DOCUMENT
    WIZ_VERSION                    int64,
    INFO_CHANGED                   int,
    DATA_CHANGED                   int,
+   DOCUMENT_IN_TRASH              int,
    primary key (DOCUMENT_GUID)
 )
@@ -0,0 +1,7 @@
+create virtual table WIZ_DOCUMENT_FTS using fts4
+(
+   DOCUMENT_TITLE,
+   DOCUMENT_KEYWORDS,
+   DOCUMENT_AUTHOR,
+   DOCUMENT_URL
+)
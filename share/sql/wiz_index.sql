@@ -0,0 +1,15 @@
+create index if not exists WIZ_DOCUMENT_LOCATION_INDEX on WIZ_DOCUMENT (DOCUMENT_LOCATION);
+create index if not exists WIZ_DOCUMENT_TRASH_MODIFIED_INDEX on WIZ_DOCUMENT (DOCUMENT_IN_TRASH, DT_MODIFIED);
+create index if not exists WIZ_DOCUMENT_TRASH_READ_INDEX on WIZ_DOCUMENT (DOCUMENT_IN_TRASH, DOCUMENT_READ_COUNT);
+create index if not exists WIZ_DOCUMENT_VERSION_INDEX on WIZ_DOCUMENT (WIZ_VERSION);
+create index if not exists WIZ_DOCUMENT_TAG_TAG_INDEX on WIZ_DOCUMENT_TAG (TAG_GUID);
+create index if not exists WIZ_DOCUMENT_ATTACHMENT_DOCUMENT_INDEX on WIZ_DOCUMENT_ATTACHMENT (DOCUMENT_GUID);
+create index if not exists WIZ_DOCUMENT_ATTACHMENT_VERSION_INDEX on WIZ_DOCUMENT_ATTACHMENT (WIZ_VERSION);
+create trigger if not exists WIZ_DOCUMENT_IN_TRASH_INSERT after insert on WIZ_DOCUMENT
+begin
+   update WIZ_DOCUMENT set DOCUMENT_IN_TRASH=(new.DOCUMENT_LOCATION like '/Deleted Items/%') where rowid=new.rowid;
+end;
+create trigger if not exists WIZ_DOCUMENT_IN_TRASH_UPDATE after update of DOCUMENT_LOCATION on WIZ_DOCUMENT
+begin
+   update WIZ_DOCUMENT set DOCUMENT_IN_TRASH=(new.DOCUMENT_LOCATION like '/Deleted Items/%') where rowid=new.rowid;
+end;
@@ -4,10 +4,10 @@
 #include <QtGlobal>
 
 #define WIZ_CLIENT_VERSION  "2.4.2"
-#define WIZNOTE_FTS_VERSION "5"
+#define WIZNOTE_FTS_VERSION "7"
 #define WIZNOTE_THUMB_VERSION "3"
 #define WIZ_NEW_FEATURE_GUIDE_VERSION "4"
-#define WIZ_TABLE_STRUCTURE_VERSION "4"
+#define WIZ_TABLE_STRUCTURE_VERSION "5"
 
 #define USER_SETTINGS_SECTION "QT_WIZNOTE"
 
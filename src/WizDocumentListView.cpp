@@ -30,6 +30,8 @@
 
 #include "WizThumbCache.h"
 
+// rows after (and a quarter before) the visible rows whose thumbs are prefetched
+#define THUMB_PREFETCH_LOOKAHEAD    20
 
 // Document actions
 #define WIZACTION_LIST_LOCATE   QObject::tr("Locate")
@@ -155,6 +157,11 @@ WizDocumentListView::WizDocumentListView(WizExplorerApp& app, QWidget *parent /*
     connect(WizThumbCache::instance(), SIGNAL(loaded(const QString& ,const QString&)),
             SLOT(onThumbCacheLoaded(const QString&, const QString&)));
 
+    m_thumbPrefetchTimer.setSingleShot(true);
+    m_thumbPrefetchTimer.setInterval(50);
+    connect(&m_thumbPrefetchTimer, SIGNAL(timeout()), SLOT(on_thumbPrefetch_timeout()));
+    connect(verticalScrollBar(), SIGNAL(valueChanged(int)), &m_thumbPrefetchTimer, SLOT(start()));
+
     connect(WizAvatarHost::instance(), SIGNAL(loaded(const QString&)),
             SLOT(on_userAvatar_loaded(const QString&)));
 
@@ -265,6 +272,8 @@ void WizDocumentListView::resizeEvent(QResizeEvent* event)
     //QPixmapCache::clear();
     setItemsNeedUpdate();
     QListWidget::resizeEvent(event);
+
+    m_thumbPrefetchTimer.start();
 }
 
 void WizDocumentListView::setDocuments(const CWizDocumentDataArray& arrayDocument)
@@ -290,6 +299,8 @@ void WizDocumentListView::appendDocuments(const CWizDocumentDataArray& arrayDocu
 
     sortItems();
 
+    m_thumbPrefetchTimer.start();
+
     Q_EMIT documentCountChanged();
 }
 
@@ -1244,6 +1255,8 @@ void WizDocumentListView::resetItemsViewType(int type)
     }
     //
     m_app.userSettings().set("VIEW_TYPE", QString::number(type));
+
+    m_thumbPrefetchTimer.start();
 }
 
 QSize WizDocumentListView::itemSizeFromViewType(ViewType type)
@@ -1493,6 +1506,34 @@ void WizDocumentListView::onThumbCacheLoaded(const QString& strKbGUID, const QSt
     }
 }
 
+void WizDocumentListView::on_thumbPrefetch_timeout()
+{
+    if (m_nViewType != TypeThumbnail || count() == 0)
+        return;
+
+    QListWidgetItem* pFirst = itemAt(viewport()->rect().topLeft());
+    QListWidgetItem* pLast = itemAt(viewport()->rect().bottomLeft());
+    int nFirst = pFirst ? row(pFirst) : 0;
+    int nLast = pLast ? row(pLast) : count() - 1;
+
+    nFirst = qMax(0, nFirst - THUMB_PREFETCH_LOOKAHEAD / 4);
+    nLast = qMin(count() - 1, nLast + THUMB_PREFETCH_LOOKAHEAD);
+
+    // group by kb, thumbs of each kb are loaded with one query
+    QMap<QString, QStringList> mapGUID;
+    for (int i = nFirst; i <= nLast; i++) {
+        if (WizDocumentListViewDocumentItem* pItem = documentItemAt(i)) {
+            const WIZDOCUMENTDATA& doc = pItem->itemData().doc;
+            mapGUID[doc.strKbGUID].append(doc.strGUID);
+        }
+    }
+
+    QMap<QString, QStringList>::const_iterator it;
+    for (it = mapGUID.begin(); it != mapGUID.end(); it++) {
+        WizThumbCache::prefetch(it.key(), it.value());
+    }
+}
+
 void WizDocumentListView::resetSectionData()
 {
     updateSectionItems();
@@ -123,6 +123,9 @@ private:
 
     QPointer<QPropertyAnimation> m_scrollAnimation;
 
+    // prefetch thumbs of visible rows after scrolling or reloading
+    QTimer m_thumbPrefetchTimer;
+
     QAction* findAction(const QString& strName);
 
     void resetPermission();
@@ -203,6 +206,7 @@ public Q_SLOTS:
     void on_document_abstractLoaded(const WIZABSTRACT& abs);
     void on_userAvatar_loaded(const QString& strUserGUID);
     void onThumbCacheLoaded(const QString& strKbGUID, const QString& strGUID);
+    void on_thumbPrefetch_timeout();
 
 
 
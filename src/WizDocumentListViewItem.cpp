@@ -534,15 +534,11 @@ void WizDocumentListViewDocumentItem::drawPrivateSummaryView_impl(QPainter* p, c
     bool bFocused = listWidget()->hasFocus();
 
     WIZABSTRACT thumb;
-    WizThumbCache::instance()->find(m_data.doc.strKbGUID, m_data.doc.strGUID, thumb);
+    QPixmap pmt;
+    WizThumbCache::instance()->find(m_data.doc.strKbGUID, m_data.doc.strGUID, thumb, pmt);
 
     QRect rcd = drawItemBackground(p, vopt->rect, bSelected, bFocused);
 
-    QPixmap pmt;
-    if (!thumb.image.isNull()) {
-        pmt = QPixmap::fromImage(thumb.image);
-    }
-
     rcd.setTop(rcd.top() + nTextTopMargin);
     int nType = badgeType(true);
     Utils::WizStyleHelper::drawListViewItemThumb(p, rcd, nType, m_data.doc.strTitle, m_data.infoList,
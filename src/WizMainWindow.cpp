@@ -3960,6 +3960,7 @@ void WizMainWindow::showDocumentList(WizCategoryBaseView* category)
     if (!kbGUID.isEmpty())
     {
         resetPermission(kbGUID, "");
+        WizSyncSetKbOpened(kbGUID);
     }
 
     CWizDocumentDataArray arrayDocument;
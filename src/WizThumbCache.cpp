@@ -4,12 +4,18 @@
 #include "share/WizDatabase.h"
 #include "share/WizThreads.h"
 
+#include <QApplication>
+#include <QThread>
 
-#define THUMB_CACHE_MAX 10000
+
+// memory budget of cached thumbs, about 2000 notes with image and abstract
+#define THUMB_CACHE_MAX_BYTES       (32 * 1024 * 1024)
+#define THUMB_CACHE_ITEM_OVERHEAD   256
 
 
 WizThumbCachePrivate::WizThumbCachePrivate(WizThumbCache* cache)
-    : q(cache)
+    : m_cacheThumb(THUMB_CACHE_MAX_BYTES)
+    , q(cache)
 {
     connect(WizDatabaseManager::instance(), SIGNAL(documentAbstractModified(const WIZDOCUMENTDATA&)),
             SLOT(onNoteThumbChanged(const WIZDOCUMENTDATA&)));
@@ -22,23 +28,62 @@ QString WizThumbCachePrivate::key(const QString& strKbGUID, const QString& strGU
     return strKbGUID + "::" + strGUID;
 }
 
-bool WizThumbCachePrivate::find(const QString& strKbGUID, const QString& strGUID, WIZABSTRACT& abs)
+bool WizThumbCachePrivate::find(const QString& strKbGUID, const QString& strGUID, WIZABSTRACT& abs, QPixmap* pixmap)
 {
     QString strKey(key(strKbGUID, strGUID));
-    if (m_mapThumb.contains(strKey)) {
-        abs = m_mapThumb.value(strKey);
-        return true;
-    }
+    {
+        QMutexLocker locker(&m_mutex);
+        if (WizThumbCacheItem* pItem = m_cacheThumb.object(strKey)) {
+            if (pixmap) {
+                Q_ASSERT(QThread::currentThread() == qApp->thread());
+                if (pItem->pixmap.isNull() && !pItem->abs.image.isNull()) {
+                    pItem->pixmap = QPixmap::fromImage(pItem->abs.image);
+                    pItem->abs.image = QImage();
+                }
+                *pixmap = pItem->pixmap;
+            }
+
+            abs = pItem->abs;
+            if (!pixmap && abs.image.isNull() && !pItem->pixmap.isNull()) {
+                abs.image = pItem->pixmap.toImage();
+            }
+            return true;
+        }
 
-    if (m_mapThumb.size() >= THUMB_CACHE_MAX) {
-        m_mapThumb.clear();
-        qDebug() << "[ThumCache]pool is full, clear...";
+        // already requested by prefetch or previous paint
+        if (m_setLoading.contains(strKey))
+            return false;
+
+        m_setLoading.insert(strKey);
     }
 
     load(strKbGUID, strGUID);
     return false;
 }
 
+void WizThumbCachePrivate::prefetch(const QString& strKbGUID, const QStringList& listGUID)
+{
+    QStringList listLoad;
+    {
+        QMutexLocker locker(&m_mutex);
+        foreach (const QString& strGUID, listGUID) {
+            QString strKey(key(strKbGUID, strGUID));
+            if (m_cacheThumb.contains(strKey) || m_setLoading.contains(strKey))
+                continue;
+
+            m_setLoading.insert(strKey);
+            listLoad.append(strGUID);
+        }
+    }
+
+    if (listLoad.isEmpty())
+        return;
+
+    WizExecuteOnThread(WIZ_THREAD_DEFAULT, [=](){
+        prefetch_impl(strKbGUID, listLoad);
+    });
+}
+
 void WizThumbCachePrivate::load(const QString& strKbGUID, const QString& strGUID)
 {
     WizExecuteOnThread(WIZ_THREAD_DEFAULT, [=](){
@@ -50,37 +95,86 @@ void WizThumbCachePrivate::load_impl(const QString& strKbGUID, const QString& st
 {
     if (!WizDatabaseManager::instance()->isOpened(strKbGUID)) {
         qDebug() << "[ThumbCache]discard for invalid kb: " << strKbGUID;
+        QMutexLocker locker(&m_mutex);
+        m_setLoading.remove(key(strKbGUID, strGUID));
         return;
     }
 
     WIZABSTRACT abs;
     WizDatabase& db = WizDatabaseManager::instance()->db(strKbGUID);
 
-    bool bUpdated = false;
-
-    // update if not exist
-    if (db.padAbstractFromGuid(strGUID, abs)) {
-        bUpdated = false;
-    } else {
+    // generate if not exist, thumb is reloaded when abstract modified
+    if (!db.padAbstractFromGuid(strGUID, abs)) {
         qDebug() << "[ThumbCache]thumb not exist, try update: " << strGUID;
-        if (db.updateDocumentAbstract(strGUID)) {
-            bUpdated = true;
-        } else {
-            bUpdated = false;
+        db.updateDocumentAbstractLater(strGUID, true);
+    }
+
+    insert(strKbGUID, strGUID, abs);
+}
+
+void WizThumbCachePrivate::prefetch_impl(const QString& strKbGUID, const QStringList& listGUID)
+{
+    if (!WizDatabaseManager::instance()->isOpened(strKbGUID)) {
+        qDebug() << "[ThumbCache]discard prefetch for invalid kb: " << strKbGUID;
+        QMutexLocker locker(&m_mutex);
+        foreach (const QString& strGUID, listGUID) {
+            m_setLoading.remove(key(strKbGUID, strGUID));
         }
+        return;
     }
 
-    // load again if updated
-    if (bUpdated && !db.padAbstractFromGuid(strGUID, abs)) {
-        qDebug() << "[ThumCache]failed to load thumb from db: " << strGUID;
+    WizDatabase& db = WizDatabaseManager::instance()->db(strKbGUID);
+
+    CWizStdStringArray arrayGUID;
+    foreach (const QString& strGUID, listGUID) {
+        arrayGUID.push_back(strGUID);
+    }
+
+    // visible notes which are saved but not regenerated yet go first
+    db.prioritizeDocumentAbstracts(arrayGUID);
+
+    std::map<CString, WIZABSTRACT> mapAbstract;
+    db.padAbstractsFromGuids(arrayGUID, mapAbstract);
+
+    foreach (const QString& strGUID, listGUID) {
+        std::map<CString, WIZABSTRACT>::iterator it = mapAbstract.find(strGUID);
+        if (it != mapAbstract.end()) {
+            insert(strKbGUID, strGUID, it->second);
+        } else {
+            // abstract not generated yet
+            db.updateDocumentAbstractLater(strGUID, true);
+
+            WIZABSTRACT abs;
+            insert(strKbGUID, strGUID, abs);
+        }
     }
+}
 
+void WizThumbCachePrivate::insert(const QString& strKbGUID, const QString& strGUID, WIZABSTRACT& abs)
+{
     abs.strKbGUID = strKbGUID;
     if (abs.text.isEmpty()) {
         abs.text = " ";
     }
 
-    m_mapThumb.insert(key(strKbGUID, strGUID), abs);
+    // decoded on this thread, converted to the format painted without conversion
+    if (!abs.image.isNull() && abs.image.format() != QImage::Format_ARGB32_Premultiplied) {
+        abs.image = abs.image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    }
+
+    int nCost = abs.text.size() * sizeof(QChar)
+            + abs.image.bytesPerLine() * abs.image.height()
+            + THUMB_CACHE_ITEM_OVERHEAD;
+
+    QString strKey(key(strKbGUID, strGUID));
+    {
+        QMutexLocker locker(&m_mutex);
+        m_setLoading.remove(strKey);
+        WizThumbCacheItem* pItem = new WizThumbCacheItem();
+        pItem->abs = abs;
+        m_cacheThumb.insert(strKey, pItem, nCost);
+    }
+
     Q_EMIT thumbLoaded(strKbGUID, strGUID);
 }
 
@@ -117,3 +211,13 @@ bool WizThumbCache::find(const QString& strKbGUID, const QString& strGUID, WIZAB
 {
     return d->find(strKbGUID, strGUID, abs);
 }
+
+bool WizThumbCache::find(const QString& strKbGUID, const QString& strGUID, WIZABSTRACT& abs, QPixmap& pixmap)
+{
+    return d->find(strKbGUID, strGUID, abs, &pixmap);
+}
+
+void WizThumbCache::prefetch(const QString& strKbGUID, const QStringList& listGUID)
+{
+    d->prefetch(strKbGUID, listGUID);
+}
@@ -2,8 +2,10 @@
 #define CORE_THUMBCACHE_H
 
 #include <QObject>
+#include <QStringList>
 
 struct WIZABSTRACT;
+class QPixmap;
 
 class WizThumbCachePrivate;
 
@@ -17,6 +19,10 @@ public:
 
     static WizThumbCache* instance();
     static bool find(const QString& strKbGUID, const QString& strGUID, WIZABSTRACT& abs);
+    // gui thread only, pixmap is converted once and shared between paints
+    static bool find(const QString& strKbGUID, const QString& strGUID, WIZABSTRACT& abs, QPixmap& pixmap);
+    // load thumbs which are not cached yet with one query on background thread
+    static void prefetch(const QString& strKbGUID, const QStringList& listGUID);
 
 Q_SIGNALS:
     void loaded(const QString& strKbGUID, const QString& strGUID);
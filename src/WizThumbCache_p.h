@@ -2,14 +2,23 @@
 #define THUMBCACHE_P_H
 
 #include <QObject>
-#include <QMap>
+#include <QCache>
+#include <QMutex>
+#include <QSet>
+#include <QStringList>
+#include <QPixmap>
 
-
-struct WIZABSTRACT;
-struct WIZDOCUMENTDATA;
+#include "share/WizObject.h"
 
 class WizThumbCache;
 
+struct WizThumbCacheItem
+{
+    WIZABSTRACT abs;
+    // created on gui thread at first paint, abs.image is released after that
+    QPixmap pixmap;
+};
+
 
 class WizThumbCachePrivate : public QObject
 {
@@ -17,12 +26,15 @@ class WizThumbCachePrivate : public QObject
 
 public:
     WizThumbCachePrivate(WizThumbCache* cache);
-    bool find(const QString& strKbGUID, const QString& strGUID, WIZABSTRACT& abs);
+    bool find(const QString& strKbGUID, const QString& strGUID, WIZABSTRACT& abs, QPixmap* pixmap = NULL);
+    void prefetch(const QString& strKbGUID, const QStringList& listGUID);
 
 private:
     QString key(const QString& strKbGUID, const QString& strGUID);
     void load(const QString& strKbGUID, const QString& strGUID);
     void load_impl(const QString& strKbGUID, const QString& strGUID);
+    void prefetch_impl(const QString& strKbGUID, const QStringList& listGUID);
+    void insert(const QString& strKbGUID, const QString& strGUID, WIZABSTRACT& abs);
 
 protected Q_SLOTS:
     void onNoteThumbChanged(const WIZDOCUMENTDATA& data);
@@ -31,7 +43,12 @@ Q_SIGNALS:
     void thumbLoaded(const QString& strKbGUID, const QString& strGUID);
 
 private:
-    QMap<QString, WIZABSTRACT> m_mapThumb;
+    // least recently used thumbs are evicted when memory budget is exceeded,
+    // cost of each entry is the approximate bytes of image and text.
+    QCache<QString, WizThumbCacheItem> m_cacheThumb;
+    // keys which are being loaded on background thread
+    QSet<QString> m_setLoading;
+    QMutex m_mutex;
     WizThumbCache* q;
 };
 
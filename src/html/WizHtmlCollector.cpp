@@ -4,6 +4,7 @@
 #include "utils/WizMisc.h"
 #include "WizMainWindow.h"
 #include <QEventLoop>
+#include <QSet>
 #include <QFile>
 #include <QTimer>
 #include <QDebug>
@@ -350,38 +351,114 @@ bool WizHtmlCollector::html2Zip(const QString& strExtResourcePath, \
 }
 
 /* -------------------------- CWizHtmlToPlainText -------------------------- */
-WizHtmlToPlainText::WizHtmlToPlainText()
+static bool isSkippedTag(const QString& strTagName)
 {
+    return strTagName == "head" || strTagName == "script" || strTagName == "style";
 }
 
-bool WizHtmlToPlainText::toText(const QString& strHtmlAll, QString& strPlainText)
+// tags separate words, others (b, span, a...) are inline
+static bool isBlockTag(const QString& strTagName)
 {
-    WizHtml2Text(strHtmlAll,strPlainText);
-    strPlainText.replace("\n", " ");
+    static const QSet<QString> tags = QSet<QString>()
+            << "br" << "p" << "div" << "li" << "ul" << "ol" << "dl" << "dt" << "dd"
+            << "tr" << "td" << "th" << "table" << "blockquote" << "pre" << "hr"
+            << "h1" << "h2" << "h3" << "h4" << "h5" << "h6" << "img" << "title" << "body";
+    return tags.contains(strTagName);
+}
 
-    //CWizHtmlReader 的解析方法存在残留标签的问题，需要修正
-//    m_strText.clear();
+WizHtmlToPlainText::WizHtmlToPlainText()
+    : m_nSkipDepth(0)
+    , m_bLastIsSpace(true)
+{
+}
 
-//    // remove head or title if exists
-//    QString strHtml = strHtmlAll;
-//    strHtml.replace(QRegExp("<head>.*</head>", Qt::CaseInsensitive), "");
-//    strHtml.replace(QRegExp("<title>.*</title>", Qt::CaseInsensitive), "");
+bool WizHtmlToPlainText::toText(const QString& strHtml, QString& strPlainText)
+{
+    m_strText.clear();
+    m_strText.reserve(strHtml.length() / 2);
+    m_nSkipDepth = 0;
+    m_bLastIsSpace = true;
 
-//    CWizHtmlReader reader;
-//    reader.setEventHandler(this);
-//    reader.setBoolOption(CWizHtmlReader::resolveEntities, true);
+    WizHtmlReader reader;
+    reader.setEventHandler(this);
+    reader.setEventMask(WizHtmlReader::notifyTagStart
+                        | WizHtmlReader::notifyTagEnd
+                        | WizHtmlReader::notifyCharacters);
+    reader.setBoolOption(WizHtmlReader::resolveEntities, true);
+    reader.setBoolOption(WizHtmlReader::parseAttributes, false);
+    reader.read(strHtml);
 
-//    reader.Read(strHtml);
+    if (m_strText.endsWith(' '))
+        m_strText.chop(1);
 
-//    m_strText.replace('\0', ' '); // otherwise sqlite statement will be failed!
-//    strPlainText = m_strText.simplified();
+    strPlainText = m_strText;
+    m_strText.clear();
     return true;
 }
 
+void WizHtmlToPlainText::startTag(WizHtmlTag* pTag, DWORD dwAppData, bool& bAbort)
+{
+    Q_UNUSED(dwAppData);
+    Q_UNUSED(bAbort);
+
+    QString strTagName = pTag->getTagName().toLower();
+    if (isSkippedTag(strTagName)) {
+        // <script/> is opening and closing tag at the same time
+        if (!pTag->isClosing())
+            m_nSkipDepth++;
+        return;
+    }
+
+    // head, or a script or style in it, ends where body starts even if it's not closed
+    if (strTagName == "body")
+        m_nSkipDepth = 0;
+
+    if (isBlockTag(strTagName))
+        appendSpace();
+}
+
+void WizHtmlToPlainText::endTag(WizHtmlTag* pTag, DWORD dwAppData, bool& bAbort)
+{
+    Q_UNUSED(dwAppData);
+    Q_UNUSED(bAbort);
+
+    QString strTagName = pTag->getTagName().toLower();
+    if (isSkippedTag(strTagName)) {
+        if (!pTag->isOpening() && m_nSkipDepth > 0)
+            m_nSkipDepth--;
+        return;
+    }
+
+    if (isBlockTag(strTagName))
+        appendSpace();
+}
+
 void WizHtmlToPlainText::characters(const CString &rText, DWORD dwAppData, bool &bAbort)
 {
     Q_UNUSED(dwAppData);
     Q_UNUSED(bAbort);
 
-    m_strText.push_back(rText + " ");
+    if (m_nSkipDepth > 0)
+        return;
+
+    const QChar* p = rText.constData();
+    const QChar* end = p + rText.length();
+    for (; p < end; p++) {
+        // '\0' would break sqlite statement
+        if (p->isSpace() || p->isNull() || p->unicode() == 0xfffc) {
+            appendSpace();
+        } else {
+            m_strText.append(*p);
+            m_bLastIsSpace = false;
+        }
+    }
+}
+
+void WizHtmlToPlainText::appendSpace()
+{
+    if (m_bLastIsSpace)
+        return;
+
+    m_strText.append(' ');
+    m_bLastIsSpace = true;
 }
@@ -66,6 +66,8 @@ protected:
     bool downloadImage(const QString& strUrl, QString& strFileName);
 };
 
+// single pass html to text, does not depend on QTextDocument and could be used
+// in any thread. <head>, <script> and <style> are skipped, whitespace is collapsed.
 class WizHtmlToPlainText : public WizHtmlReaderEvents
 {
 public:
@@ -73,10 +75,16 @@ public:
     bool toText(const QString& strHtml, QString& strPlainText);
 
 protected:
+    virtual void startTag(WizHtmlTag* pTag, DWORD dwAppData, bool& bAbort);
+    virtual void endTag(WizHtmlTag* pTag, DWORD dwAppData, bool& bAbort);
     virtual void characters(const CString& rText, DWORD dwAppData, bool& bAbort);
 
 private:
+    void appendSpace();
+
     QString m_strText;
+    int m_nSkipDepth;
+    bool m_bLastIsSpace;
 };
 
 #endif // WIZHTMLCOLLECTOR_H
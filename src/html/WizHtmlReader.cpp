@@ -1192,6 +1192,34 @@ WizHtmlTag::WizHtmlTag(WizHtmlTag &rSource, bool bCopy)
     }
 }
 
+// find '>' (or '/>') which ends a tag, '>' inside quoted attribute values is skipped
+static const unsigned short* WizHtmlFindTagEnd(const unsigned short* lpszBegin)
+{
+    unsigned short chQuote = 0;
+    unsigned short chPrev = 0;
+    for (const unsigned short* p = lpszBegin; *p; p++)
+    {
+        unsigned short ch = *p;
+        if (chQuote)
+        {
+            if (ch == chQuote)
+                chQuote = 0;
+        }
+        else if ((ch == '"' || ch == '\'') && chPrev == '=')
+        {
+            chQuote = ch;
+        }
+        else if (ch == '>')
+        {
+            return (p > lpszBegin && *(p - 1) == '/') ? p - 1 : p;
+        }
+        //
+        if (!::wiz_isspace(ch))
+            chPrev = ch;
+    }
+    return NULL;
+}
+
 UINT WizHtmlTag::parseFromStr(const unsigned short* lpszString,
                                       bool &bIsOpeningTag,
                                       bool &bIsClosingTag,
@@ -1353,7 +1381,12 @@ UINT WizHtmlTag::parseFromStr(const unsigned short* lpszString,
             // attribute/value pairs could not be parsed?
         {
             WIZ_SAFE_DELETE_POINTER(pcollAttr);
-            if ((lpszEnd = ::wiz_strstr(lpszBegin, "/>")) == NULL)
+            if (!bParseAttrib)
+            {
+                if ((lpszEnd = WizHtmlFindTagEnd(lpszBegin)) == NULL)
+                    return (0U);
+            }
+            else if ((lpszEnd = ::wiz_strstr(lpszBegin, "/>")) == NULL)
             {
                 if ((lpszEnd = ::wiz_strchr(lpszBegin, _T('>'))) == NULL)
                     return (0U);
@@ -1490,6 +1523,7 @@ void WizHtmlTag::removeAttribute(const CString& strAttributeName)
 WizHtmlReader::WizHtmlReader()
 {
     m_bResolveEntities = false;	    // entities are resolved, by default
+    m_bParseAttributes = true;
     m_dwAppData = 0L;	// reasonable default!
     m_dwBufPos = 0L;	// start from the very beginning
     m_dwBufLen = 0L;	// buffer length is unknown yet
@@ -1584,6 +1618,12 @@ bool WizHtmlReader::getBoolOption(ReaderOptionsEnum option, bool& bCurVal) const
             bSuccess = true;
             break;
         }
+    case parseAttributes:
+        {
+            bCurVal = m_bParseAttributes;
+            bSuccess = true;
+            break;
+        }
     default:
         {
             bSuccess = false;
@@ -1605,6 +1645,12 @@ bool WizHtmlReader::setBoolOption(ReaderOptionsEnum option, bool bNewVal)
             bSuccess = true;
             break;
         }
+    case parseAttributes:
+        {
+            m_bParseAttributes = bNewVal;
+            bSuccess = true;
+            break;
+        }
     default:
         {
             bSuccess = false;
@@ -1670,7 +1716,7 @@ bool WizHtmlReader::parseTag(WizHtmlTag &rTag,
     ATLASSERT(m_dwBufPos + 3 <= m_dwBufLen);
 
     UINT nRetVal = rTag.parseFromStr(&m_lpszBuffer[m_dwBufPos],
-                                     bIsOpeningTag, bIsClosingTag);
+                                     bIsOpeningTag, bIsClosingTag, m_bParseAttributes);
     if (!nRetVal)
         return (false);
 
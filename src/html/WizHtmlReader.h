@@ -172,7 +172,8 @@ public:
 	};
 
 	enum ReaderOptionsEnum {
-        resolveEntities	    // determines whether entity references should be resolved
+        resolveEntities,    // determines whether entity references should be resolved
+        parseAttributes     // determines whether attribute/value pairs of tags should be parsed
 	};
 
 // Construction/Destruction
@@ -211,6 +212,7 @@ protected:
 
 protected:
 	bool	m_bResolveEntities;
+	bool	m_bParseAttributes;
 	DWORD	m_dwAppData;
 	DWORD	m_dwBufPos;
 	DWORD	m_dwBufLen;
@@ -9,13 +9,20 @@
 #include "CLucene/analysis/standard/StandardTokenizer.h"
 #include "CLucene/queryParser/MultiFieldQueryParser.h"
 #include "CLucene/analysis/standard/StandardFilter.h"
+#include "CLucene/search/FieldCache.h"
 
 #include <map>
+#include <list>
+#include <queue>
+#include <functional>
 #include <deque>
 #include <fstream>
 #include <cassert>
 
 #include <QStringList>
+#include <QSet>
+#include <QMutex>
+#include <QDateTime>
 #include <QDebug>
 
 /*
@@ -447,16 +454,31 @@ std::string WizW2A(const std::wstring& str)
 #define WIZTOOLS_FTS_MAX_FILE_LENGTH		(5 * 1024 * 1024)
 
 
+/*
+ * one document per note, text is indexed twice in the same document:
+ * "contents" by cjk (bigram) analyzer and "contents3" by cjk3 (unigram) analyzer
+ */
+#define WIZ_FTS_FIELD_CONTENTS      L"contents"
+#define WIZ_FTS_FIELD_CONTENTS3     L"contents3"
+#define WIZ_FTS_FIELD_TITLE         L"title"
+// days since 1970, not stored, loaded by FieldCache for recency boost
+#define WIZ_FTS_FIELD_MODIFIED      L"modified"
+
+#define WIZ_FTS_SECONDS_PER_DAY     (24 * 60 * 60)
+#define WIZ_FTS_TITLE_BOOST         4.0f
+#define WIZ_FTS_RECENCY_BOOST       0.5f
+#define WIZ_FTS_RECENCY_DAYS        30
+
 struct WIZFTSDATA
 {
         lucene::index::IndexWriter* writer;
-        LanguageBasedAnalyzer an;
-        LanguageBasedAnalyzer an3;
+        lucene::analysis::PerFieldAnalyzerWrapper an;
 
-        WIZFTSDATA() : writer(NULL)
+        WIZFTSDATA()
+            : writer(NULL)
+            , an(_CLNEW LanguageBasedAnalyzer(L"cjk"))
         {
-                an.setLanguage(L"cjk");
-                an3.setLanguage(L"cjk3");
+                an.addAnalyzer(WIZ_FTS_FIELD_CONTENTS3, _CLNEW LanguageBasedAnalyzer(L"cjk3"));
         }
 
         ~WIZFTSDATA()
@@ -489,7 +511,8 @@ struct WIZFTSDATA
 //	}
 //};
 
-bool WizCluceneSearch::beginUpdateDocument(const wchar_t* lpszIndexPath, void** ppHandle)
+bool WizCluceneSearch::beginUpdateDocument(const wchar_t* lpszIndexPath, void** ppHandle,
+                                           float ramBufferSizeMB, int mergeFactor)
 {
     std::wstring strIndexPath(lpszIndexPath);
     WizPathRemoveBackslash(strIndexPath);
@@ -512,6 +535,12 @@ bool WizCluceneSearch::beginUpdateDocument(const wchar_t* lpszIndexPath, void**
 
         if (pData->writer) {
 			pData->writer->setMaxFieldLength(WIZTOOLS_FTS_MAX_FILE_LENGTH);
+            if (ramBufferSizeMB > 0) {
+                pData->writer->setRAMBufferSizeMB(ramBufferSizeMB);
+            }
+            if (mergeFactor > 1) {
+                pData->writer->setMergeFactor(mergeFactor);
+            }
 			*ppHandle = pData;
             return true;
         } else {
@@ -531,7 +560,29 @@ bool WizCluceneSearch::beginUpdateDocument(const wchar_t* lpszIndexPath, void**
 	}
 }
 
-bool WizCluceneSearch::endUpdateDocument(void* pHandle)
+bool WizCluceneSearch::commitUpdateDocument(void* pHandle)
+{
+    WIZFTSDATA* pData = (WIZFTSDATA*)pHandle;
+    if (!pData) {
+        return false;
+    }
+
+    try {
+        pData->writer->flush();
+        return true;
+
+    } catch (CLuceneError& e) {
+        TOLOG(L"Indexing exception in WizFTSCommitUpdateDocument");
+        TOLOG(e.twhat());
+        return false;
+
+    } catch (...) {
+        TOLOG(L"Unknown exception in WizFTSCommitUpdateDocument");
+        return false;
+    }
+}
+
+bool WizCluceneSearch::endUpdateDocument(void* pHandle, bool bOptimize)
 {
 	WIZFTSDATA* pData = (WIZFTSDATA*)pHandle;
     if (!pData) {
@@ -539,7 +590,9 @@ bool WizCluceneSearch::endUpdateDocument(void* pHandle)
     }
 
     try {
-        pData->writer->optimize();
+        if (bOptimize) {
+            pData->writer->optimize();
+        }
         pData->writer->close();
 		delete pData;
         return true;
@@ -559,18 +612,18 @@ bool WizCluceneSearch::updateDocument(void* pHandle,
                                        const wchar_t* lpszKbGUID,
                                        const wchar_t* lpszDocumentID,
                                        const wchar_t* lpszTitle,
-                                       const wchar_t* lpszText)
+                                       const wchar_t* lpszText,
+                                       qint64 tModified /* = 0 */)
 {
-    Q_UNUSED(lpszTitle);
-
     assert(pHandle && lpszKbGUID && lpszDocumentID && lpszTitle && lpszText);
 
     WIZFTSDATA* pData = (WIZFTSDATA*)pHandle;
 
     std::wstring strKbGUID(lpszKbGUID);
     std::wstring strDocumentID(lpszDocumentID);
-    //std::wstring strTitle(lpszTitle);
+    std::wstring strTitle(lpszTitle);
     std::wstring strText(lpszText);
+    std::wstring strModified = QString::number(tModified / WIZ_FTS_SECONDS_PER_DAY).toStdWString();
 
     try {
 
@@ -582,6 +635,7 @@ bool WizCluceneSearch::updateDocument(void* pHandle,
             }
         }
 
+        // second document of a note indexed by old schema, if index was not rebuilt
         {
             lucene::index::Term* term2 = _CLNEW lucene::index::Term(L"documentid2", strDocumentID.c_str());
             if (term2)
@@ -601,19 +655,249 @@ bool WizCluceneSearch::updateDocument(void* pHandle,
         lucene::document::Document doc;
         doc.add( *_CLNEW lucene::document::Field(L"documentid", strDocumentID.c_str(), lucene::document::Field::STORE_YES | lucene::document::Field::INDEX_UNTOKENIZED ) );
         doc.add( *_CLNEW lucene::document::Field(L"kbguid", strKbGUID.c_str(), lucene::document::Field::STORE_YES | lucene::document::Field::INDEX_UNTOKENIZED ) );
-        doc.add( *_CLNEW lucene::document::Field(L"contents", strText.c_str(), lucene::document::Field::STORE_NO | lucene::document::Field::INDEX_TOKENIZED) );
+        doc.add( *_CLNEW lucene::document::Field(WIZ_FTS_FIELD_CONTENTS, strText.c_str(), lucene::document::Field::STORE_NO | lucene::document::Field::INDEX_TOKENIZED) );
+        doc.add( *_CLNEW lucene::document::Field(WIZ_FTS_FIELD_CONTENTS3, strText.c_str(), lucene::document::Field::STORE_NO | lucene::document::Field::INDEX_TOKENIZED) );
+        doc.add( *_CLNEW lucene::document::Field(WIZ_FTS_FIELD_TITLE, strTitle.c_str(), lucene::document::Field::STORE_NO | lucene::document::Field::INDEX_TOKENIZED) );
+        doc.add( *_CLNEW lucene::document::Field(WIZ_FTS_FIELD_MODIFIED, strModified.c_str(), lucene::document::Field::STORE_NO | lucene::document::Field::INDEX_UNTOKENIZED) );
         pData->writer->addDocument(&doc, &pData->an);
     }
 
+    return true;
+}
+
+// document guid -> kb guid
+typedef std::map<std::string, std::string> CWizFTSResultMap;
+
+#define WIZ_FTS_QUERY_CACHE_MAX     32
+
+/*
+ * reader and searcher are shared by all searches and kept opened, they are
+ * reopened only if indexer committed a new generation. hits of recent keyword
+ * lists are cached, so repeated or reverted searches don't query index again,
+ * and refining a search ("foo" -> "foo bar") only queries new keywords.
+ */
+struct WIZFTSSEARCHDATA
+{
+    QMutex mutex;
+    std::string strIndexPath;
+    lucene::index::IndexReader* reader;
+    lucene::search::IndexSearcher* searcher;
+    // most recent used at front
+    std::list<std::pair<std::wstring, CWizFTSResultMap> > cache;
+
+    WIZFTSSEARCHDATA()
+        : reader(NULL)
+        , searcher(NULL)
     {
-        lucene::document::Document doc;
-        doc.add( *_CLNEW lucene::document::Field(L"documentid2", strDocumentID.c_str(), lucene::document::Field::STORE_YES | lucene::document::Field::INDEX_UNTOKENIZED ) );
-        doc.add( *_CLNEW lucene::document::Field(L"kbguid", strKbGUID.c_str(), lucene::document::Field::STORE_YES | lucene::document::Field::INDEX_UNTOKENIZED ) );
-        doc.add( *_CLNEW lucene::document::Field(L"contents", strText.c_str(), lucene::document::Field::STORE_NO | lucene::document::Field::INDEX_TOKENIZED) );
-        pData->writer->addDocument(&doc, &pData->an3);
     }
 
-    return true;
+    void close()
+    {
+        cache.clear();
+        if (searcher) {
+            searcher->close();
+            _CLDELETE(searcher);
+        }
+        if (reader) {
+            reader->close();
+            _CLDELETE(reader);
+        }
+        strIndexPath.clear();
+    }
+
+    lucene::search::IndexSearcher* open(const std::string& strIndexPathA)
+    {
+        if (reader && strIndexPath == strIndexPathA) {
+            if (reader->isCurrent())
+                return searcher;
+
+            lucene::index::IndexReader* newReader = reader->reopen();
+            if (newReader != reader) {
+                searcher->close();
+                _CLDELETE(searcher);
+                reader->close();
+                _CLDELETE(reader);
+                reader = newReader;
+                searcher = _CLNEW lucene::search::IndexSearcher(reader);
+            }
+            cache.clear();
+            return searcher;
+        }
+
+        close();
+        if (!lucene::index::IndexReader::indexExists(strIndexPathA.c_str()))
+            return NULL;
+
+        reader = lucene::index::IndexReader::open(strIndexPathA.c_str());
+        searcher = _CLNEW lucene::search::IndexSearcher(reader);
+        strIndexPath = strIndexPathA;
+        return searcher;
+    }
+
+    const CWizFTSResultMap* findCache(const std::wstring& strKeyword)
+    {
+        std::list<std::pair<std::wstring, CWizFTSResultMap> >::iterator it;
+        for (it = cache.begin(); it != cache.end(); it++) {
+            if (it->first == strKeyword) {
+                cache.splice(cache.begin(), cache, it);
+                return &cache.front().second;
+            }
+        }
+        return NULL;
+    }
+
+    // cached list with most keywords which are all in listKey, listRest gets the others
+    const CWizFTSResultMap* findSubsetCache(const QStringList& listKey, QStringList& listRest)
+    {
+        QSet<QString> setKey = listKey.toSet();
+        std::list<std::pair<std::wstring, CWizFTSResultMap> >::iterator itFound = cache.end();
+        QSet<QString> setFound;
+        std::list<std::pair<std::wstring, CWizFTSResultMap> >::iterator it;
+        for (it = cache.begin(); it != cache.end(); it++) {
+            QSet<QString> setCached = QString::fromStdWString(it->first).split(getWizSearchSplitChar(), QString::SkipEmptyParts).toSet();
+            if (setCached.size() > setFound.size() && setKey.contains(setCached)) {
+                itFound = it;
+                setFound = setCached;
+            }
+        }
+
+        if (itFound == cache.end())
+            return NULL;
+
+        listRest.clear();
+        foreach (const QString& strKey, listKey) {
+            if (!setFound.contains(strKey) && !listRest.contains(strKey)) {
+                listRest.append(strKey);
+            }
+        }
+
+        cache.splice(cache.begin(), cache, itFound);
+        return &cache.front().second;
+    }
+
+    const CWizFTSResultMap* addCache(const std::wstring& strKeyword, const CWizFTSResultMap& mapResult)
+    {
+        cache.push_front(std::make_pair(strKeyword, mapResult));
+        if (cache.size() > WIZ_FTS_QUERY_CACHE_MAX) {
+            cache.pop_back();
+        }
+        return &cache.front().second;
+    }
+};
+
+static WIZFTSSEARCHDATA& WizFTSSearchData()
+{
+    // never deleted, closed by WizCluceneSearch::closeSearcher before clucene shutdown
+    static WIZFTSSEARCHDATA* data = new WIZFTSSEARCHDATA();
+    return *data;
+}
+
+// match keyword with both tokenized fields in one pass, return NULL if nothing to search
+static lucene::search::BooleanQuery* WizFTSCreateKeywordQuery(const std::wstring& strKeyword, bool bTitle)
+{
+    LanguageBasedAnalyzer analyzer(L"cjk");
+    LanguageBasedAnalyzer analyzer3(L"cjk3");
+    lucene::search::BooleanQuery* query = _CLNEW lucene::search::BooleanQuery();
+
+    lucene::search::Query* queryContents = lucene::queryParser::QueryParser::parse(strKeyword.c_str(), WIZ_FTS_FIELD_CONTENTS, &analyzer);
+    if (queryContents) {
+        query->add(queryContents, true, lucene::search::BooleanClause::SHOULD);
+    }
+
+    lucene::search::Query* queryContents3 = lucene::queryParser::QueryParser::parse(strKeyword.c_str(), WIZ_FTS_FIELD_CONTENTS3, &analyzer3);
+    if (queryContents3) {
+        query->add(queryContents3, true, lucene::search::BooleanClause::SHOULD);
+    }
+
+    if (bTitle) {
+        lucene::search::Query* queryTitle = lucene::queryParser::QueryParser::parse(strKeyword.c_str(), WIZ_FTS_FIELD_TITLE, &analyzer);
+        if (queryTitle) {
+            queryTitle->setBoost(WIZ_FTS_TITLE_BOOST);
+            query->add(queryTitle, true, lucene::search::BooleanClause::SHOULD);
+        }
+    }
+
+    if (query->getClauseCount() == 0) {
+        _CLDELETE(query);
+        return NULL;
+    }
+
+    return query;
+}
+
+// all keywords are required, intersection is done by ConjunctionScorer while
+// walking posting lists, so rarest keyword drives the cost.
+// return NULL if any keyword has nothing to search
+static lucene::search::BooleanQuery* WizFTSCreateQuery(const QStringList& listKey, bool bTitle)
+{
+    if (listKey.isEmpty())
+        return NULL;
+
+    lucene::search::BooleanQuery* query = _CLNEW lucene::search::BooleanQuery();
+    for (int i = 0; i < listKey.count(); i++) {
+        lucene::search::BooleanQuery* queryKeyword = WizFTSCreateKeywordQuery(listKey.at(i).toStdWString(), bTitle);
+        if (!queryKeyword) {
+            _CLDELETE(query);
+            return NULL;
+        }
+
+        query->add(queryKeyword, true, lucene::search::BooleanClause::MUST);
+    }
+
+    return query;
+}
+
+// guid is ascii, no locale conversion needed
+static std::string WizFTSFieldToString(const TCHAR* lpszValue)
+{
+    std::string str;
+    if (!lpszValue)
+        return str;
+
+    size_t nLength = _tcslen(lpszValue);
+    str.resize(nLength);
+    for (size_t i = 0; i < nLength; i++) {
+        str[i] = (char)lpszValue[i];
+    }
+
+    return str;
+}
+
+// collect matched document numbers only, Hits would re-run query while paging
+class WizFTSDocsCollector : public lucene::search::HitCollector
+{
+public:
+    virtual void collect(const int32_t doc, const float_t score)
+    {
+        Q_UNUSED(score);
+        m_arrayDoc.push_back(doc);
+    }
+
+    std::vector<int32_t> m_arrayDoc;
+};
+
+static void WizFTSSearchQuery(lucene::search::IndexSearcher* searcher,
+                              lucene::search::Query* query,
+                              CWizFTSResultMap& mapResult)
+{
+    qDebug() << "Search document contents";
+
+    WizFTSDocsCollector collector;
+    searcher->_search(query, NULL, &collector);
+
+    std::vector<int32_t>::const_iterator it;
+    for (it = collector.m_arrayDoc.begin(); it != collector.m_arrayDoc.end(); it++) {
+        lucene::document::Document doc;
+        if (!searcher->doc(*it, doc))
+            continue;
+
+        const TCHAR* kbid = doc.get(L"kbguid");
+        const TCHAR* docid = doc.get(L"documentid");
+
+        if (docid) {
+            mapResult[WizFTSFieldToString(docid)] = WizFTSFieldToString(kbid);
+        }
+    }
 }
 
 bool WizCluceneSearch::searchDocument(const wchar_t* lpszIndexPath,
@@ -623,100 +907,221 @@ bool WizCluceneSearch::searchDocument(const wchar_t* lpszIndexPath,
     WizPathRemoveBackslash(strIndexPath);
     std::string strIndexPathA = WizW2A(strIndexPath);
 
-    const wchar_t* arrAnalyzer[] = {
-        L"cjk",
-        L"cjk3",
-        NULL
-    };
-
-    //const wchar_t* fields[] = {L"title", L"contents", NULL};
-
-    std::map<std::string, std::string> mapGUIDOdd;
-    std::map<std::string, std::string> mapGUIDEven;
-    QStringList listKey = QString::fromWCharArray(lpszKeywords).split(getWizSearchSplitChar());
+    QStringList listKey = QString::fromWCharArray(lpszKeywords).split(getWizSearchSplitChar(), QString::SkipEmptyParts);
     if (listKey.isEmpty())
         return false;
 
-    try {
-        lucene::search::IndexSearcher searcher(strIndexPathA.c_str());
+    // normalized keywords as cache key
+    std::wstring strKeywords = listKey.join(getWizSearchSplitChar()).toStdWString();
 
-        for (int keyIndex = 0; keyIndex < listKey.count(); keyIndex++)
-        {
-            std::wstring strKeywords = listKey.at(keyIndex).toStdWString();
+    CWizFTSResultMap mapResult;
 
-            std::map<std::string, std::string>& mapGUIDOld = keyIndex % 2 == 0 ? mapGUIDOdd : mapGUIDEven;
-            std::map<std::string, std::string>& mapGUIDCur = keyIndex % 2 == 0 ? mapGUIDEven : mapGUIDOdd;
+    try {
+        WIZFTSSEARCHDATA& data = WizFTSSearchData();
+        QMutexLocker locker(&data.mutex);
 
-            for (int i = 0; ; i++)
-            {
-                if (!arrAnalyzer[i])
-                    break;
+        lucene::search::IndexSearcher* searcher = data.open(strIndexPathA);
+        if (!searcher)
+            return false;
 
-                //for (int j = 0; ; j++) {
-                //    if (!fields[j]) break;
+        const CWizFTSResultMap* pMapCached = data.findCache(strKeywords);
+        if (pMapCached) {
+            mapResult = *pMapCached;
+        } else {
+            // only keywords not in a cached list are queried, then intersected with it
+            QStringList listRest = listKey;
+            pMapCached = data.findSubsetCache(listKey, listRest);
+            if (pMapCached && listRest.isEmpty()) {
+                mapResult = *pMapCached;
+            } else if (!pMapCached || !pMapCached->empty()) {
+                CWizFTSResultMap mapRest;
+                lucene::search::BooleanQuery* query = WizFTSCreateQuery(listRest, false);
+                if (query) {
+                    WizFTSSearchQuery(searcher, query, mapRest);
+                    _CLDELETE(query);
+                }
 
-                LanguageBasedAnalyzer analyzer(arrAnalyzer[i]);
-                lucene::search::Query* query = lucene::queryParser::QueryParser::parse(strKeywords.c_str(), L"contents", &analyzer);
+                if (!pMapCached) {
+                    mapResult.swap(mapRest);
+                } else {
+                    CWizFTSResultMap::const_iterator it;
+                    for (it = pMapCached->begin(); it != pMapCached->end(); it++) {
+                        if (mapRest.find(it->first) != mapRest.end()) {
+                            mapResult.insert(*it);
+                        }
+                    }
+                }
+            }
 
-                qDebug() << "Search document contents";
+            data.addCache(strKeywords, mapResult);
+        }
 
-                if (!query) {
-                    continue;
-                }
+    } catch (CLuceneError& e) {
+		TOLOG(e.twhat());
+        return false;
 
-                lucene::search::Hits* hits = searcher.search(query);
-                if (!hits) {
-                    _CLDELETE(query);
-                    continue;
-                }
+    } catch (...) {
+        return false;
+	}
 
-                for (size_t j = 0;j < hits->length(); j++ ) {
-                    lucene::document::Document* doc = &hits->doc(j);
-                    const TCHAR* kbid = doc->get(L"kbguid");
-                    const TCHAR* docid = doc->get(L"documentid");
-                    if (!docid) {
-                        docid = doc->get(L"documentid2");
-                    }
+    // searcher is unlocked, handlers may take a while to load documents
+    CWizFTSResultMap::const_iterator iterator;
+    for (iterator = mapResult.begin(); iterator != mapResult.end(); iterator++)
+    {
+        onSearchProcess(iterator->second, iterator->first, "");
+    }
 
-                    if (docid) {
-                        std::string strDocumentGUID = ::WizW2A(docid);
-                        std::string strDocumentKBGUID = ::WizW2A(kbid);
-                        if (mapGUIDCur.find(strDocumentGUID) == mapGUIDCur.end()) {
-                            if (keyIndex > 0 && mapGUIDOld.find(strDocumentGUID) != mapGUIDOld.end())
-                            {
-                                mapGUIDCur[strDocumentGUID] = strDocumentKBGUID;
-                                qDebug() << "Document finded  guid: " << QString(strDocumentGUID.data());
-                            }
-                            else if (keyIndex == 0)
-                            {
-                                mapGUIDCur[strDocumentGUID] = strDocumentKBGUID;
-                                qDebug() << "Document finded  guid: " << QString(strDocumentGUID.data());
-                            }
+    onSearchEnd();
+    return true;
+}
 
-                        }
-                    }
-                }
+/*
+ * keep best nTopK hits only, hits are never materialized as Hits / Document.
+ * score = lucene score * (1 + WIZ_FTS_RECENCY_BOOST * days / (days + age)), so
+ * a note modified today gets WIZ_FTS_RECENCY_BOOST more, and half of it after
+ * WIZ_FTS_RECENCY_DAYS.
+ */
+class WizFTSTopDocsCollector : public lucene::search::HitCollector
+{
+public:
+    typedef std::pair<float_t, int32_t> CWizScoreDoc;   // score, doc number
+
+    WizFTSTopDocsCollector(size_t nTopK, const int32_t* pModified, int32_t nModifiedCount, int32_t nToday)
+        : m_nTopK(nTopK)
+        , m_pModified(pModified)
+        , m_nModifiedCount(nModifiedCount)
+        , m_nToday(nToday)
+        , m_nTotal(0)
+    {
+    }
 
-                _CLDELETE(query);
-                //}
-            }
-            mapGUIDOld.clear();
+    virtual void collect(const int32_t doc, const float_t score)
+    {
+        m_nTotal++;
+
+        // can't beat the worst one even with max recency boost, skip it
+        if (m_heap.size() >= m_nTopK
+                && score * (1.0f + WIZ_FTS_RECENCY_BOOST) <= m_heap.top().first)
+            return;
+
+        float_t fScore = score * recency(doc);
+        if (m_heap.size() < m_nTopK) {
+            m_heap.push(CWizScoreDoc(fScore, doc));
+        } else if (fScore > m_heap.top().first) {
+            m_heap.pop();
+            m_heap.push(CWizScoreDoc(fScore, doc));
         }
+    }
 
-        std::map<std::string, std::string>& mapGUIDCur =
-                (listKey.count() % 2 == 0) ?  mapGUIDOdd : mapGUIDEven;
-        std::map<std::string, std::string>::iterator iterator;
-        for (iterator = mapGUIDCur.begin(); iterator != mapGUIDCur.end(); iterator++)
-        {
-            std::string strDocumentGUID = iterator->first;
-            std::string strDocumentKBGUID = iterator->second;
-            onSearchProcess(strDocumentKBGUID, strDocumentGUID, "");
+    // best first
+    void topDocs(std::vector<CWizScoreDoc>& arrayDoc)
+    {
+        arrayDoc.resize(m_heap.size());
+        for (size_t i = arrayDoc.size(); i > 0; i--) {
+            arrayDoc[i - 1] = m_heap.top();
+            m_heap.pop();
         }
+    }
+
+    int totalHits() const { return m_nTotal; }
+
+private:
+    float_t recency(int32_t doc) const
+    {
+        if (!m_pModified || doc >= m_nModifiedCount || m_pModified[doc] <= 0)
+            return 1.0f;
+
+        int32_t nAge = m_nToday - m_pModified[doc];
+        if (nAge < 0)
+            nAge = 0;
+
+        return 1.0f + WIZ_FTS_RECENCY_BOOST * WIZ_FTS_RECENCY_DAYS / (float_t)(WIZ_FTS_RECENCY_DAYS + nAge);
+    }
 
-        searcher.close();
-        onSearchEnd();
+    size_t m_nTopK;
+    const int32_t* m_pModified;
+    int32_t m_nModifiedCount;
+    int32_t m_nToday;
+    int m_nTotal;
+    // min heap, worst kept hit at top
+    std::priority_queue<CWizScoreDoc, std::vector<CWizScoreDoc>, std::greater<CWizScoreDoc> > m_heap;
+};
+
+bool WizCluceneSearch::searchTopDocuments(const wchar_t* lpszIndexPath,
+                                           const wchar_t* lpszKeywords,
+                                           int nTopK,
+                                           std::vector<WIZFTSHIT>& arrayHit,
+                                           const wchar_t* lpszKbGUID /* = NULL */,
+                                           bool bExcludeKbGUID /* = false */)
+{
+    arrayHit.clear();
+    if (nTopK <= 0)
         return true;
 
+    std::wstring strIndexPath(lpszIndexPath);
+    WizPathRemoveBackslash(strIndexPath);
+    std::string strIndexPathA = WizW2A(strIndexPath);
+
+    QStringList listKey = QString::fromWCharArray(lpszKeywords).split(getWizSearchSplitChar(), QString::SkipEmptyParts);
+    if (listKey.isEmpty())
+        return false;
+
+    try {
+        WIZFTSSEARCHDATA& data = WizFTSSearchData();
+        QMutexLocker locker(&data.mutex);
+
+        lucene::search::IndexSearcher* searcher = data.open(strIndexPathA);
+        if (!searcher)
+            return false;
+
+        lucene::search::BooleanQuery query;
+        lucene::search::BooleanQuery* queryKeywords = WizFTSCreateQuery(listKey, true);
+        if (!queryKeywords)
+            return true;
+
+        query.add(queryKeywords, true, lucene::search::BooleanClause::MUST);
+
+        if (lpszKbGUID && *lpszKbGUID) {
+            lucene::index::Term* term = _CLNEW lucene::index::Term(L"kbguid", lpszKbGUID);
+            query.add(_CLNEW lucene::search::TermQuery(term), true,
+                      bExcludeKbGUID ? lucene::search::BooleanClause::MUST_NOT
+                                     : lucene::search::BooleanClause::MUST);
+            _CLDECDELETE(term);
+        }
+
+        // modified days of all documents, cached by clucene per reader
+        lucene::search::FieldCacheAuto* modified = lucene::search::FieldCache::DEFAULT()->getInts(data.reader, WIZ_FTS_FIELD_MODIFIED);
+        int32_t nToday = (int32_t)(QDateTime::currentDateTime().toTime_t() / WIZ_FTS_SECONDS_PER_DAY);
+
+        WizFTSTopDocsCollector collector(nTopK,
+                                         modified ? modified->intArray : NULL,
+                                         modified ? modified->contentLen : 0,
+                                         nToday);
+        searcher->_search(&query, NULL, &collector);
+
+        std::vector<WizFTSTopDocsCollector::CWizScoreDoc> arrayDoc;
+        collector.topDocs(arrayDoc);
+
+        // load stored fields of top documents only
+        for (size_t i = 0; i < arrayDoc.size(); i++) {
+            lucene::document::Document doc;
+            if (!searcher->doc(arrayDoc[i].second, doc))
+                continue;
+
+            const TCHAR* kbid = doc.get(L"kbguid");
+            const TCHAR* docid = doc.get(L"documentid");
+            if (!docid || !kbid)
+                continue;
+
+            WIZFTSHIT hit;
+            hit.strKbGUID = WizFTSFieldToString(kbid);
+            hit.strDocumentID = WizFTSFieldToString(docid);
+            hit.fScore = arrayDoc[i].first;
+            arrayHit.push_back(hit);
+        }
+
+        qDebug() << "[Search]ranked search, total hits:" << collector.totalHits() << "returned:" << arrayHit.size();
+
     } catch (CLuceneError& e) {
 		TOLOG(e.twhat());
         return false;
@@ -724,6 +1129,21 @@ bool WizCluceneSearch::searchDocument(const wchar_t* lpszIndexPath,
     } catch (...) {
         return false;
 	}
+
+    return true;
+}
+
+void WizCluceneSearch::closeSearcher()
+{
+    WIZFTSSEARCHDATA& data = WizFTSSearchData();
+    QMutexLocker locker(&data.mutex);
+
+    try {
+        data.close();
+    } catch (CLuceneError& e) {
+        TOLOG(e.twhat());
+    } catch (...) {
+    }
 }
 
 bool WizCluceneSearch::deleteDocument(const wchar_t* lpszIndexPath,
@@ -754,6 +1174,7 @@ bool WizCluceneSearch::deleteDocument(const wchar_t* lpszIndexPath,
             }
         }
 
+        // indexed by old schema
         {
             lucene::index::Term* term = _CLNEW lucene::index::Term(L"documentid2", strWizDocumentID.c_str());
             if (term)
@@ -778,6 +1199,33 @@ bool WizCluceneSearch::deleteDocument(const wchar_t* lpszIndexPath,
 }
 
 
+bool WizCluceneSearch::deleteDocument(void* pHandle, const wchar_t* lpszDocumentID)
+{
+    WIZFTSDATA* pData = (WIZFTSDATA*)pHandle;
+    if (!pData) {
+        return false;
+    }
+
+    std::wstring strWizDocumentID(lpszDocumentID);
+
+    try {
+        pData->writer->deleteDocuments(_CLNEW lucene::index::Term(L"documentid", strWizDocumentID.c_str()));
+        // indexed by old schema
+        pData->writer->deleteDocuments(_CLNEW lucene::index::Term(L"documentid2", strWizDocumentID.c_str()));
+        return true;
+
+    } catch (CLuceneError& e) {
+        TOLOG(L"Indexing exception in WizToolsFTSDeleteDocument");
+        TOLOG(e.twhat());
+        return false;
+
+    } catch (...) {
+        TOLOG(L"Unknown exception in WizToolsFTSDeleteDocument");
+        return false;
+    }
+}
+
+
 #ifdef WIZ_FTS_ENABLE_TEST
 
 void _testCJK(const char* astr, bool ignoreSurrogates = true) 
@@ -3,21 +3,44 @@
 
 #include <QtGlobal>
 #include <string>
+#include <vector>
+
+struct WIZFTSHIT
+{
+    std::string strKbGUID;
+    std::string strDocumentID;
+    float fScore;
+};
 
 // interface
 class WizCluceneSearch
 {
 protected:
-    bool beginUpdateDocument(const wchar_t* lpszIndexPath, void** ppHandle);
-    bool endUpdateDocument(void* pHandle);
+    // ramBufferSizeMB / mergeFactor <= 0 keep clucene defaults
+    bool beginUpdateDocument(const wchar_t* lpszIndexPath, void** ppHandle,
+                             float ramBufferSizeMB = 0, int mergeFactor = 0);
+    // flush buffered documents and deletions as a new index generation
+    bool commitUpdateDocument(void* pHandle);
+    bool endUpdateDocument(void* pHandle, bool bOptimize = true);
     bool updateDocument(void* pHandle,
                         const wchar_t* lpszKbGUID,
                         const wchar_t* lpszDocumentID,
                         const wchar_t* lpszTitle,
-                        const wchar_t* lpszText);
+                        const wchar_t* lpszText,
+                        qint64 tModified = 0);    // seconds since 1970, used by ranking
 
     bool deleteDocument(const wchar_t* lpszIndexPath, const wchar_t* lpszDocumentID);
+    bool deleteDocument(void* pHandle, const wchar_t* lpszDocumentID);
     bool searchDocument(const wchar_t* lpszIndexPath, const wchar_t* lpszKeywords);
+    // best nTopK documents containing all keywords, ordered by score.
+    // title matches and recently modified documents are boosted.
+    // lpszKbGUID: only (or bExcludeKbGUID: never) return documents of this kb
+    bool searchTopDocuments(const wchar_t* lpszIndexPath, const wchar_t* lpszKeywords,
+                            int nTopK, std::vector<WIZFTSHIT>& arrayHit,
+                            const wchar_t* lpszKbGUID = NULL, bool bExcludeKbGUID = false);
+    // searcher is shared and kept opened between searches, close it before
+    // index files are deleted or application quits.
+    static void closeSearcher();
 
     virtual bool onSearchProcess(const std::string& lpszKbGUID,
                                  const std::string& lpszDocumentID,
@@ -35,6 +35,7 @@
 #include "sync/WizApiEntry.h"
 #include "share/WizThreads.h"
 #include "WizMessageBox.h"
+#include "WizSettings.h"
 
 #define WIZNOTE_THUMB_VERSION "3"
 
@@ -46,6 +47,9 @@
 
 #define WIZKMSYNC_EXIT_INFO     "WIZKMSYNC_EXIT_INFO"
 
+// parts of objects not resumed for this long are removed from download cache
+#define WIZ_DOWNLOAD_CACHE_EXPIRE_DAYS  7
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //class CWizDocument
 
@@ -635,6 +639,7 @@ const QString g_strAccountSection = "Account";
 const QString g_strCertSection = "Cert";
 const QString g_strGroupSection = "Groups";
 const QString g_strDatabaseInfoSection = "Database";
+const QString g_strAbstractSection = "Abstract";
 
 #define WIZ_META_KBINFO_SECTION "KB_INFO"
 #define WIZ_META_SYNCINFO_SECTION "SYNC_INFO"
@@ -644,10 +649,17 @@ WizDatabase::WizDatabase()
     : m_ziwReader(new WizZiwReader())
     , m_bIsPersonal(true)
     , m_mutexCache(QMutex::Recursive)
+    , m_bAbstractQueueRunning(false)
 {
     m_ziwReader->setDatabase(this);
 }
 
+WizDatabase::~WizDatabase()
+{
+    // temporary database may be destroyed without close()
+    WizUserSettingsCache::instance()->removeDatabase(this);
+}
+
 QString WizDatabase::getUserId()
 {
     return m_strUserId;
@@ -778,6 +790,9 @@ bool WizDatabase::onDownloadStyleList(const CWizStyleDataArray& arrayData)
 
 bool WizDatabase::onDownloadDocumentList(const CWizDocumentDataArray& arrayData)
 {
+    // one transaction per page
+    WizIndexTransaction transaction(*this);
+
     for (std::deque<WIZDOCUMENTDATAEX>::const_iterator itDocument = arrayData.begin();
          itDocument != arrayData.end();
          itDocument++)
@@ -787,9 +802,13 @@ bool WizDatabase::onDownloadDocumentList(const CWizDocumentDataArray& arrayData)
         if (!onDownloadDocument(*itDocument))
         {
             //m_pEvents->OnError(WizFormatString1("Cannot update note information: %1", itDocument->strTitle));
+            transaction.commit();
             return FALSE;
         }
+        transaction.next();
     }
+
+    transaction.commit();
     return true;
 }
 
@@ -925,6 +944,91 @@ bool WizDatabase::updateObjectData(const QString& strDisplayName,
     return updateSyncObjectLocalData(data);
 }
 
+QString WizDatabase::getObjectDownloadFileName(const WIZOBJECTDATA& data)
+{
+    QString strPath = getDownloadCachePath();
+    QString strName = data.strObjectGUID + "-" + QString::number(data.nVersion) + ".download";
+
+    QDir dir(strPath);
+    QStringList listFile = dir.entryList(QStringList(data.strObjectGUID + "-*"), QDir::Files);
+    foreach (const QString& strFile, listFile) {
+        if (!strFile.startsWith(strName)) {
+            dir.remove(strFile);
+        }
+    }
+
+    return strPath + strName;
+}
+
+bool WizDatabase::updateObjectDataByFile(const QString& strDisplayName,
+                                          const QString& strObjectGUID,
+                                          const QString& strObjectType,
+                                          const QString& strFileName,
+                                          const QString& strMD5)
+{
+    qDebug() << "update object data by file, name: " << strDisplayName << "guid: " << strObjectGUID;
+
+    if (strObjectType == WIZDOCUMENTATTACHMENTDATAEX::objectName())
+    {
+        // data md5 of attachment is the md5 of extracted file, not of the zip
+        WIZDOCUMENTATTACHMENTDATA attachment;
+        attachmentFromGuid(strObjectGUID, attachment);
+        bool ret = extractCompressedAttachmentFile(strObjectGUID, strFileName, attachment.strDataMD5);
+        QFile::remove(strFileName);
+        if (!ret)
+        {
+            Q_EMIT updateError("Failed to save attachment data: " + strDisplayName);
+            return false;
+        }
+    }
+    else if (strObjectType == WIZDOCUMENTDATAEX::objectName())
+    {
+        WIZDOCUMENTDATA document;
+        if (!documentFromGuid(strObjectGUID, document)) {
+            qCritical() << "Update object data failed, can't find database record!\n";
+            QFile::remove(strFileName);
+            return false;
+        }
+
+        // broken or outdated download, keep local note data
+        if (!document.strDataMD5.isEmpty() && 0 != document.strDataMD5.compare(strMD5, Qt::CaseInsensitive)) {
+            TOLOG2("Downloaded document md5 does not match: %1, %2", strDisplayName, strMD5);
+            QFile::remove(strFileName);
+            Q_EMIT updateError("Downloaded document data is broken: " + strDisplayName);
+            return false;
+        }
+
+        // existing note file is only replaced when the new one is complete,
+        // it is kept if anything fails
+        CString strDocumentFileName = getDocumentFileName(strObjectGUID);
+        if (!::WizReplaceFile(strFileName, strDocumentFileName))
+        {
+            // download cache may be on another volume, copy it beside the note first
+            QString strTempFileName = strDocumentFileName + ".tmp";
+            bool ret = ::WizCopyFile(strFileName, strTempFileName, FALSE)
+                    && ::WizReplaceFile(strTempFileName, strDocumentFileName);
+            QFile::remove(strFileName);
+            if (!ret)
+            {
+                QFile::remove(strTempFileName);
+                Q_EMIT updateError("Failed to save document data: " + strDisplayName);
+                return false;
+            }
+        }
+
+        Q_EMIT documentDataModified(document);
+        updateDocumentAbstractLater(strObjectGUID);
+        setDocumentSearchIndexed(strObjectGUID, false);
+    } else {
+        Q_ASSERT(0);
+        return false;
+    }
+
+    setObjectDataDownloaded(strObjectGUID, strObjectType, true);
+
+    return true;
+}
+
 bool WizDatabase::initDocumentData(const QString& strGUID,
                                     WIZDOCUMENTDATAEX& data)
 {
@@ -1950,6 +2054,7 @@ bool WizDatabase::updateMessages(const CWizMessageDataArray& arrayMsg)
     qint64 nVersion = -1;
 
     bool bHasError = false;
+    WizIndexTransaction transaction(*this);
     CWizMessageDataArray::const_iterator it;
     for (it = arrayMsg.begin(); it != arrayMsg.end(); it++)
     {
@@ -1959,12 +2064,14 @@ bool WizDatabase::updateMessages(const CWizMessageDataArray& arrayMsg)
         }
 
         nVersion = qMax(nVersion, msg.nVersion);
+        transaction.next();
     }
 
     if (!bHasError) {
         setObjectVersion(WIZMESSAGEDATA::objectName(), nVersion);
     }
 
+    transaction.commit();
     return !bHasError;
 }
 
@@ -2283,6 +2390,7 @@ bool WizDatabase::updateDeletedGuids(const CWizDeletedGUIDDataArray& arrayDelete
     qint64 nVersion = -1;
 
     bool bHasError = false;
+    WizIndexTransaction transaction(*this);
 
     CWizDeletedGUIDDataArray::const_iterator it;
     for (it = arrayDeletedGUID.begin(); it != arrayDeletedGUID.end(); it++) {
@@ -2293,12 +2401,14 @@ bool WizDatabase::updateDeletedGuids(const CWizDeletedGUIDDataArray& arrayDelete
         }
 
         nVersion = qMax(nVersion, data.nVersion);
+        transaction.next();
     }
 
     if (!bHasError) {
         setObjectVersion(WIZDELETEDGUIDDATA::objectName(), nVersion);
     }
 
+    transaction.commit();
     return !bHasError;
 }
 
@@ -2345,9 +2455,29 @@ bool WizDatabase::open(const QString& strAccountFolderName, const QString& strKb
 
     loadDatabaseInfo();
 
+    loadDocumentAbstractQueue();
+
+    if (m_bIsPersonal) {
+        WizUserSettingsCache::instance()->addDatabase(this);
+        // download cache is shared by all databases of the account
+        removeStaleDownloadFiles();
+    }
+
     return true;
 }
 
+void WizDatabase::close()
+{
+    saveDocumentAbstractQueue();
+
+    // before database is destroyed, cache may be used by other threads meanwhile
+    if (m_bIsPersonal) {
+        WizUserSettingsCache::instance()->removeDatabase(this);
+    }
+
+    WizIndex::close();
+}
+
 bool WizDatabase::loadDatabaseInfo()
 {
     QString strUserId = getMetaDef(g_strAccountSection, "USERID");
@@ -2563,6 +2693,28 @@ QString WizDatabase::getAvatarPath() const
     return strPath;
 }
 
+QString WizDatabase::getDownloadCachePath() const
+{
+    QString strPath = getAccountPath() + "cache/download/";
+    WizEnsurePathExists(strPath);
+
+    return strPath;
+}
+
+void WizDatabase::removeStaleDownloadFiles()
+{
+    // objects deleted on server or not needed anymore are never resumed
+    QDateTime tExpired = QDateTime::currentDateTime().addDays(-WIZ_DOWNLOAD_CACHE_EXPIRE_DAYS);
+
+    QDir dir(getDownloadCachePath());
+    QFileInfoList listFile = dir.entryInfoList(QStringList() << "*.part" << "*.download", QDir::Files);
+    foreach (const QFileInfo& info, listFile) {
+        if (info.lastModified() < tExpired) {
+            QFile::remove(info.absoluteFilePath());
+        }
+    }
+}
+
 QString WizDatabase::getDefaultNoteLocation() const
 {
     if (m_bIsPersonal)
@@ -2830,6 +2982,7 @@ bool WizDatabase::updateBizUsers(const CWizBizUserDataArray& arrayUser)
         return false;
 
     bool bHasError = false;
+    WizIndexTransaction transaction(*this);
     CWizBizUserDataArray::const_iterator it;
     for (it = arrayUser.begin(); it != arrayUser.end(); it++)
     {
@@ -2837,8 +2990,10 @@ bool WizDatabase::updateBizUsers(const CWizBizUserDataArray& arrayUser)
         if (!updateBizUser(user)) {
             bHasError = true;
         }
+        transaction.next();
     }
 
+    transaction.commit();
     return !bHasError;
 }
 
@@ -2998,6 +3153,7 @@ bool WizDatabase::updateTags(const CWizTagDataArray& arrayTag)
     qint64 nVersion = -1;
 
     bool bHasError = false;
+    WizIndexTransaction transaction(*this);
     CWizTagDataArray::const_iterator it;
     for (it = arrayTag.begin(); it != arrayTag.end(); it++) {
         const WIZTAGDATA& tag = *it;
@@ -3009,12 +3165,14 @@ bool WizDatabase::updateTags(const CWizTagDataArray& arrayTag)
         }
 
         nVersion = qMax(nVersion, tag.nVersion);
+        transaction.next();
     }
 
     if (!bHasError) {
         setObjectVersion(WIZTAGDATA::objectName(), nVersion);
     }
 
+    transaction.commit();
     return !bHasError;
 }
 
@@ -3027,6 +3185,7 @@ bool WizDatabase::updateStyles(const CWizStyleDataArray& arrayStyle)
     qint64 nVersion = -1;
 
     bool bHasError = false;
+    WizIndexTransaction transaction(*this);
     CWizStyleDataArray::const_iterator it;
     for (it = arrayStyle.begin(); it != arrayStyle.end(); it++) {
         const WIZSTYLEDATA& data = *it;
@@ -3038,12 +3197,14 @@ bool WizDatabase::updateStyles(const CWizStyleDataArray& arrayStyle)
         }
 
         nVersion = qMax(nVersion, data.nVersion);
+        transaction.next();
     }
 
     if (!bHasError) {
         setObjectVersion(WIZSTYLEDATA::objectName(), nVersion);
     }
 
+    transaction.commit();
     return !bHasError;
 }
 
@@ -3055,6 +3216,7 @@ bool WizDatabase::updateDocuments(const std::deque<WIZDOCUMENTDATAEX>& arrayDocu
     qint64 nVersion = -1;
 
     bool bHasError = false;
+    WizIndexTransaction transaction(*this);
     std::deque<WIZDOCUMENTDATAEX>::const_iterator it;
     for (it = arrayDocument.begin(); it != arrayDocument.end(); it++) {
         const WIZDOCUMENTDATAEX& data = *it;
@@ -3066,12 +3228,14 @@ bool WizDatabase::updateDocuments(const std::deque<WIZDOCUMENTDATAEX>& arrayDocu
         }
 
         nVersion = qMax(nVersion, data.nVersion);
+        transaction.next();
     }
 
     if (!bHasError) {
         setObjectVersion(WIZDOCUMENTDATAEX::objectName(), nVersion);
     }
 
+    transaction.commit();
     return !bHasError;
 }
 
@@ -3083,6 +3247,7 @@ bool WizDatabase::updateAttachments(const CWizDocumentAttachmentDataArray& array
     qint64 nVersion = -1;
 
     bool bHasError = false;
+    WizIndexTransaction transaction(*this);
 
     std::deque<WIZDOCUMENTATTACHMENTDATAEX>::const_iterator it;
     for (it = arrayAttachment.begin(); it != arrayAttachment.end(); it++) {
@@ -3095,12 +3260,15 @@ bool WizDatabase::updateAttachments(const CWizDocumentAttachmentDataArray& array
         }
 
         nVersion = qMax(nVersion, data.nVersion);
+        transaction.next();
     }
 
     if (!bHasError) {
         setObjectVersion(WIZDOCUMENTATTACHMENTDATAEX::objectName(), nVersion);
     }
 
+    transaction.commit();
+
     emit attachmentsUpdated();
 
     return !bHasError;
@@ -3199,7 +3367,7 @@ bool WizDatabase::updateDocumentDataMD5(WIZDOCUMENTDATA& data, const CString& st
 {
     bool bRet = WizIndex::updateDocumentDataMD5(data, strZipFileName, notifyDataModify);
 
-    updateDocumentAbstract(data.strGUID);
+    updateDocumentAbstractLater(data.strGUID);
 
     return bRet;
 }
@@ -3406,7 +3574,7 @@ bool WizDatabase::updateSyncObjectLocalData(const WIZOBJECTDATA& data)
         }
 
         Q_EMIT documentDataModified(document);
-        updateDocumentAbstract(data.strObjectGUID);
+        updateDocumentAbstractLater(data.strObjectGUID);
         setDocumentSearchIndexed(data.strObjectGUID, false);
     } else {
         Q_ASSERT(0);
@@ -3883,23 +4051,53 @@ bool WizDatabase::saveCompressedAttachmentData(const CString& strGUID, const QBy
         Q_EMIT updateError("Failed to save attachment data to temp file: " + strTempZipFileName);
         return false;
     }
+    //
+    if (!extractCompressedAttachmentFile(strGUID, strTempZipFileName))
+        return false;
+    //
+    QFile::remove(strTempZipFileName);
+    //
+    return true;
+}
+
+bool WizDatabase::extractCompressedAttachmentFile(const CString& strGUID, const QString& strZipFileName,
+                                                  const QString& strDataMD5 /* = QString() */)
+{
     WizUnzipFile zip;
-    if (!zip.open(strTempZipFileName))
+    if (!zip.open(strZipFileName))
     {
-        Q_EMIT updateError("Failed to open temp zip file: " + strTempZipFileName);
+        Q_EMIT updateError("Failed to open temp zip file: " + strZipFileName);
         return false;
     }
 
+    // extracted beside the attachment file, which is replaced when it's complete
     CString strFileName = getAttachmentFileName(strGUID);
-    if (!zip.extractFile(0, strFileName))
+    QString strTempFileName = strFileName + ".tmp";
+    if (!zip.extractFile(0, strTempFileName))
     {
+        QFile::remove(strTempFileName);
         Q_EMIT updateError("Failed to extract attachment file: " + strFileName);
         return false;
     }
 
     zip.close();
     //
-    QFile::remove(strTempZipFileName);
+    // existing attachment file is kept if the extracted one is broken
+    if (!strDataMD5.isEmpty()
+            && 0 != strDataMD5.compare(::WizMd5FileString(strTempFileName), Qt::CaseInsensitive))
+    {
+        QFile::remove(strTempFileName);
+        TOLOG1("Downloaded attachment md5 does not match: %1", strFileName);
+        Q_EMIT updateError("Downloaded attachment data is broken: " + strFileName);
+        return false;
+    }
+    //
+    if (!::WizReplaceFile(strTempFileName, strFileName))
+    {
+        QFile::remove(strTempFileName);
+        Q_EMIT updateError("Failed to save attachment file: " + strFileName);
+        return false;
+    }
     //
     return true;
 }
@@ -3939,20 +4137,22 @@ bool WizDatabase::updateDocumentAbstract(const QString& strDocumentGUID)
         }
     }
 
-    QString strTempFolder = Utils::WizPathResolve::tempPath() + data.strGUID + "-thumb/";
-    // delete folder to clear unused images.
-    ::WizDeleteAllFilesInFolder(strTempFolder);
-    if (!documentToHtmlFile(data, strTempFolder)) {
-        qDebug() << "[updateDocumentAbstract]decompress to temp failed, guid: "
+    WizUnzipFile zip;
+    if (!openDocumentZip(data, zip)) {
+        qDebug() << "[updateDocumentAbstract]open note archive failed, guid: "
                  << strDocumentGUID;
         return false;
     }
-    CString strHtmlFileName = strTempFolder + "index.html";
 
-    CString strHtmlTempPath = Utils::WizMisc::extractFilePath(strHtmlFileName);
+    QByteArray htmlData;
+    if (!zip.extractFileToData("index.html", htmlData)) {
+        qDebug() << "[updateDocumentAbstract]no index.html in note archive, guid: "
+                 << strDocumentGUID;
+        return false;
+    }
 
     CString strHtml;
-    ::WizLoadUnicodeTextFromFile(strHtmlFileName, strHtml);
+    ::WizLoadUnicodeTextFromData(htmlData, strHtml);
 
     WIZABSTRACT abstract;
     abstract.guid = strDocumentGUID;
@@ -3961,42 +4161,44 @@ bool WizDatabase::updateDocumentAbstract(const QString& strDocumentGUID)
     htmlConverter.toText(strHtml, abstract.text);
     abstract.text = abstract.text.left(2000);
 
-    CString strResourcePath = Utils::WizMisc::extractFilePath(strHtmlFileName) + "index_files/";
-    CWizStdStringArray arrayImageFileName;
-    ::WizEnumFiles(strResourcePath, "*.jpg;*.png;*.bmp;*.gif", arrayImageFileName, 0);
-    if (!arrayImageFileName.empty())
-    {
-        CString strImageFileName;
-
-        qint64 m = 0;
-        CWizStdStringArray::const_iterator it;
-        for (it = arrayImageFileName.begin(); it != arrayImageFileName.end(); it++) {
-            CString strFileName = *it;
-            //
-            QString name = Utils::WizMisc::extractFileName(strFileName);
-            if (name.startsWith("wizIcon"))
-                continue;
-            if (name.startsWith("checked"))
-                continue;
-            if (name.startsWith("unchecked"))
+    // pick the biggest image by its size in archive, only that one is decompressed
+    CString strImageFileName;
+    qint64 m = 0;
+    for (int i = 0; i < zip.count(); i++) {
+        CString strFileName = zip.fileName(i);
+        if (!strFileName.startsWith("index_files/"))
+            continue;
+        //
+        QString suffix = Utils::WizMisc::extractFileExt(strFileName).toLower();
+        if (suffix != ".jpg" && suffix != ".png" && suffix != ".bmp" && suffix != ".gif")
+            continue;
+        //
+        QString name = Utils::WizMisc::extractFileName(strFileName);
+        if (name.startsWith("wizIcon"))
+            continue;
+        if (name.startsWith("checked"))
+            continue;
+        if (name.startsWith("unchecked"))
+            continue;
+        //
+        qint64 size = zip.fileSize(strFileName);
+        if (size > m)
+        {
+            //FIXME:此处是特殊处理，解析Html的CSS时候存在问题，目前暂不删除冗余图片。
+            //缩略图需要判断当前图片确实被使用
+            if (!strHtml.contains(name))
                 continue;
-            //
-            qint64 size = Utils::WizMisc::getFileSize(strFileName);
-            if (size > m)
-            {
-                //FIXME:此处是特殊处理，解析Html的CSS时候存在问题，目前暂不删除冗余图片。
-                //缩略图需要判断当前图片确实被使用
-                QString strName = Utils::WizMisc::extractFileName(strFileName);
-                if (!strHtml.contains(strName))
-                    continue;
 
-                strImageFileName = strFileName;
-                m = size;
-            }
+            strImageFileName = strFileName;
+            m = size;
         }
+    }
 
+    if (!strImageFileName.isEmpty())
+    {
+        QByteArray imageData;
         QImage img;
-        if (!strImageFileName.isEmpty() && img.load(strImageFileName))
+        if (zip.extractFileToData(strImageFileName, imageData) && img.loadFromData(imageData))
         {
             //DEBUG_TOLOG2("Abstract image size: %1 X %2", WizIntToStr(img.width()), WizIntToStr(img.height()));
             if (img.width() > 32 && img.height() > 32)
@@ -4015,13 +4217,121 @@ bool WizDatabase::updateDocumentAbstract(const QString& strDocumentGUID)
         Q_EMIT updateError("Failed to update note abstract!");
     }
 
-    ::WizDeleteFolder(strHtmlTempPath);
-
     Q_EMIT documentAbstractModified(data);
 
     return ret;
 }
 
+void WizDatabase::updateDocumentAbstractLater(const QString& strDocumentGUID, bool bVisible /* = false */)
+{
+    QMutexLocker locker(&m_mutexAbstract);
+
+    int index = m_listAbstractQueue.indexOf(strDocumentGUID);
+    if (index != -1) {
+        // saved again before regenerated, keep one request
+        if (bVisible && index > 0) {
+            m_listAbstractQueue.move(index, 0);
+        }
+        return;
+    }
+
+    if (bVisible) {
+        m_listAbstractQueue.prepend(strDocumentGUID);
+    } else {
+        m_listAbstractQueue.append(strDocumentGUID);
+    }
+
+    if (m_bAbstractQueueRunning)
+        return;
+
+    m_bAbstractQueueRunning = true;
+    scheduleDocumentAbstractQueue();
+}
+
+void WizDatabase::prioritizeDocumentAbstracts(const CWizStdStringArray& arrayGUID)
+{
+    QMutexLocker locker(&m_mutexAbstract);
+    if (m_listAbstractQueue.isEmpty())
+        return;
+
+    int nFront = 0;
+    for (CWizStdStringArray::const_iterator it = arrayGUID.begin(); it != arrayGUID.end(); it++) {
+        int index = m_listAbstractQueue.indexOf(*it);
+        if (index >= nFront) {
+            m_listAbstractQueue.move(index, nFront);
+            nFront++;
+        }
+    }
+}
+
+void WizDatabase::scheduleDocumentAbstractQueue()
+{
+    // database may be closed before task is executed
+    QString strKbGUID = kbGUID();
+    WizExecuteOnThread(WIZ_THREAD_DEFAULT, [=]{
+        if (!WizDatabaseManager::instance()->isOpened(strKbGUID))
+            return;
+
+        WizDatabaseManager::instance()->db(strKbGUID).processDocumentAbstractQueue();
+    });
+}
+
+void WizDatabase::processDocumentAbstractQueue()
+{
+    QString strDocumentGUID;
+    {
+        QMutexLocker locker(&m_mutexAbstract);
+        if (m_listAbstractQueue.isEmpty()) {
+            m_bAbstractQueueRunning = false;
+            return;
+        }
+
+        strDocumentGUID = m_listAbstractQueue.takeFirst();
+    }
+
+    updateDocumentAbstract(strDocumentGUID);
+
+    // one document per task, so thumb loading is not blocked by a long queue
+    QMutexLocker locker(&m_mutexAbstract);
+    if (m_listAbstractQueue.isEmpty()) {
+        m_bAbstractQueueRunning = false;
+        return;
+    }
+
+    scheduleDocumentAbstractQueue();
+}
+
+void WizDatabase::saveDocumentAbstractQueue()
+{
+    QStringList listGUID;
+    {
+        // tasks scheduled already find an empty queue
+        QMutexLocker locker(&m_mutexAbstract);
+        listGUID.swap(m_listAbstractQueue);
+    }
+
+    if (listGUID.isEmpty())
+        return;
+
+    if (!setMeta(g_strAbstractSection, "Queue", listGUID.join(";"))) {
+        TOLOG1("Failed to save abstract queue of database: %1", name());
+    }
+}
+
+void WizDatabase::loadDocumentAbstractQueue()
+{
+    QString strQueue = getMetaDef(g_strAbstractSection, "Queue");
+    if (strQueue.isEmpty())
+        return;
+
+    deleteMetaByKey(g_strAbstractSection, "Queue");
+
+    QStringList listGUID = strQueue.split(';', QString::SkipEmptyParts);
+    foreach (const QString& strGUID, listGUID) {
+        updateDocumentAbstractLater(strGUID);
+    }
+}
+
 CString WizDatabase::getRootLocation(const CString& strLocation)
 {
     //FIXME:容错处理，如果路径的结尾不是 '/'，则增加该结尾符号
@@ -4258,6 +4568,49 @@ bool WizDatabase::documentToHtmlFile(const WIZDOCUMENTDATA& document,
     return WizPathFileExists(strTempHtmlFileName);
 }
 
+bool WizDatabase::openDocumentZip(const WIZDOCUMENTDATA& document, WizUnzipFile& zip)
+{
+    CString strZipFileName = getDocumentFileName(document.strGUID);
+    if (!WizPathFileExists(strZipFileName)) {
+        return false;
+    }
+    //
+    if (!WizZiwReader::isEncryptedFile(strZipFileName)) {
+        return zip.open(strZipFileName);
+    }
+    //
+    QString password = WizUserCertPassword::Instance().getPassword(bizGuid());
+    if (password.isEmpty()) {
+        return false;
+    }
+    //
+    QByteArray data;
+    {
+        // ziw reader is shared by all threads
+        QMutexLocker locker(&m_mtxTempFile);
+        if (!m_ziwReader->decryptFileToData(strZipFileName, data)) {
+            // force clear usercipher
+            WizUserCertPassword::Instance().setPassword(bizGuid(), "");
+            return false;
+        }
+    }
+    //
+    return zip.open(data);
+}
+
+bool WizDatabase::loadDocumentHtml(const WIZDOCUMENTDATA& document, QString& strHtml)
+{
+    WizUnzipFile zip;
+    if (!openDocumentZip(document, zip))
+        return false;
+    //
+    QByteArray data;
+    if (!zip.extractFileToData("index.html", data))
+        return false;
+    //
+    return ::WizLoadUnicodeTextFromData(data, strHtml);
+}
+
 bool WizDatabase::exportToHtmlFile(const WIZDOCUMENTDATA& document, const QString& strPath)
 {
     QString strTempPath = Utils::WizPathResolve::tempPath() + WizGenGUIDLowerCaseLetterOnly() + "/";
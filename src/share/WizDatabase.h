@@ -4,6 +4,7 @@
 #include <QPointer>
 #include <QMap>
 #include <QMutex>
+#include <QStringList>
 
 #include "WizIndex.h"
 #include "WizThumbIndex.h"
@@ -13,6 +14,7 @@
 class WizDatabase;
 class WizFolder;
 class WizDocument;
+class WizUnzipFile;
 
 class WizDocument : public QObject
 {
@@ -123,8 +125,20 @@ private:
     QMutex m_mutexCache;
     CWizGroupDataArray m_cachedGroups;
     CWizBizDataArray m_cachedBizs;
+
+    // documents whose abstract is waiting to be regenerated, head first
+    QMutex m_mutexAbstract;
+    QStringList m_listAbstractQueue;
+    bool m_bAbstractQueueRunning;
+
+    void scheduleDocumentAbstractQueue();
+    void processDocumentAbstractQueue();
+    // queue left when database is closed is saved in meta, loaded by next open
+    void saveDocumentAbstractQueue();
+    void loadDocumentAbstractQueue();
 public:
     WizDatabase();
+    ~WizDatabase();
 
     const WIZDATABASEINFO& info() { return m_info; }
     QString name() const { return m_info.name; }
@@ -179,6 +193,12 @@ public:
                                   const QString& strObjectGUID,
                                   const QString& strObjectType,
                                   const QByteArray& stream);
+    virtual QString getObjectDownloadFileName(const WIZOBJECTDATA& data);
+    virtual bool updateObjectDataByFile(const QString& strDisplayName,
+                                        const QString& strObjectGUID,
+                                        const QString& strObjectType,
+                                        const QString& strFileName,
+                                        const QString& strMD5);
 
     virtual bool isObjectDataDownloaded(const QString& strGUID,
                                         const QString& strType);
@@ -312,6 +332,7 @@ public:
 
 public:
     bool open(const QString& strAccountFolderName, const QString& strKbGUID = NULL);
+    void close();
     bool loadDatabaseInfo();
     bool setDatabaseInfo(const WIZDATABASEINFO& dbInfo);
     bool initDatabaseInfo(const WIZDATABASEINFO& dbInfo);
@@ -332,6 +353,7 @@ public:
     QString getDocumentFileName(const QString& strGUID) const;
     QString getAttachmentFileName(const QString& strGUID);
     QString getAvatarPath() const;
+    QString getDownloadCachePath() const;
     QString getDefaultNoteLocation() const;
     QString getDocumentAuthorAlias(const WIZDOCUMENTDATA& doc);
     QString getDocumentOwnerAlias(const WIZDOCUMENTDATA& doc);
@@ -390,6 +412,11 @@ public:
     void clearUnusedImages(const QString& strHtml, const QString& strFilePath);
 
     bool updateDocumentAbstract(const QString& strDocumentGUID);
+    // regenerate abstract on background thread, repeated requests of one document
+    // are coalesced. bVisible: document is shown in list, put it ahead of others
+    void updateDocumentAbstractLater(const QString& strDocumentGUID, bool bVisible = false);
+    // move queued documents of arrayGUID to head of queue
+    void prioritizeDocumentAbstracts(const CWizStdStringArray& arrayGUID);
 
     virtual bool updateDocumentDataMD5(WIZDOCUMENTDATA& data, const CString& strZipFileName, bool notifyDataModify = true);
 
@@ -424,6 +451,9 @@ public:
                                       QByteArray& arrayData);
     bool saveCompressedAttachmentData(const CString& strGUID,
                                       const QByteArray& arrayData);
+    bool extractCompressedAttachmentFile(const CString& strGUID,
+                                         const QString& strZipFileName,
+                                         const QString& strDataMD5 = QString());
 
     static CString getRootLocation(const CString& strLocation);
     static CString getLocationName(const CString& strLocation);
@@ -473,6 +503,9 @@ public:
                             const QString& strPath);
 
     bool extractZiwFileToFolder(const WIZDOCUMENTDATA& document, const QString& strFolder);
+    // read note archive in memory, without extracting it to temp folder
+    bool openDocumentZip(const WIZDOCUMENTDATA& document, WizUnzipFile& zip);
+    bool loadDocumentHtml(const WIZDOCUMENTDATA& document, QString& strHtml);
     bool encryptDocument(WIZDOCUMENTDATA& document);
     bool compressFolderToZiwFile(WIZDOCUMENTDATA& document, const QString& strFileFoler);
     bool compressFolderToZiwFile(WIZDOCUMENTDATA& document, \
@@ -544,6 +577,8 @@ private:
     //
     bool getAllBizInfoCore(const CWizGroupDataArray& arrayGroup, CWizBizDataArray& arrayBiz);
     bool setAllBizInfoCore(const CWizBizDataArray& arrayBiz);
+    //
+    void removeStaleDownloadFiles();
 };
 
 
@@ -16,9 +16,21 @@ WizIndex::WizIndex(void)
 
 bool WizIndex::getDocumentTags(const CString& strDocumentGUID, CWizTagDataArray& arrayTag)
 {
-    CString strWhere = WizFormatString1("TAG_GUID in (select TAG_GUID from WIZ_DOCUMENT_TAG where DOCUMENT_GUID='%1')", strDocumentGUID);
-	CString strSQL = formatQuerySQL(TABLE_NAME_WIZ_TAG, FIELD_LIST_WIZ_TAG, strWhere); 
-	return sqlToTagDataArray(strSQL, arrayTag);
+    CString strSQL = formatQuerySQL(TABLE_NAME_WIZ_TAG, FIELD_LIST_WIZ_TAG,
+                                    "TAG_GUID in (select TAG_GUID from WIZ_DOCUMENT_TAG where DOCUMENT_GUID=?)");
+
+    try
+    {
+        CppSQLite3CachedStatement stmt(m_db, strSQL);
+        stmt.bind(1, strDocumentGUID);
+        CppSQLite3Query query = stmt.execQuery();
+        queryToTagDataArray(query, arrayTag);
+        return true;
+    }
+    catch (const CppSQLite3Exception& e)
+    {
+        return logSQLException(e, strSQL);
+    }
 }
 
 bool WizIndex::getDocumentAttachments(const CString& strDocumentGUID, CWizDocumentAttachmentDataArray& arrayAttachment)
@@ -759,7 +771,7 @@ bool WizIndex::getGroupUnreadDocuments(CWizDocumentDataArray& arrayDocument)
 {
 
     QString strSQL = QString("select %1 from %2 %3").arg(FIELD_LIST_WIZ_DOCUMENT)
-            .arg(TABLE_NAME_WIZ_DOCUMENT).arg("where DOCUMENT_READ_COUNT=0 and DOCUMENT_LOCATION not like '/Deleted Items/%' limit 1000");
+            .arg(TABLE_NAME_WIZ_DOCUMENT).arg("where DOCUMENT_IN_TRASH=0 and DOCUMENT_READ_COUNT=0 limit 1000");
 
     return sqlToDocumentDataArray(strSQL, arrayDocument);
 }
@@ -767,7 +779,7 @@ bool WizIndex::getGroupUnreadDocuments(CWizDocumentDataArray& arrayDocument)
 int WizIndex::getGroupUnreadDocumentCount()
 {
     CString strSQL;
-    strSQL.format("select count(*) from WIZ_DOCUMENT where DOCUMENT_READ_COUNT=0 and DOCUMENT_LOCATION not like '/Deleted Items/%'");
+    strSQL = "select count(*) from WIZ_DOCUMENT where DOCUMENT_IN_TRASH=0 and DOCUMENT_READ_COUNT=0";
 
     CppSQLite3Query query = m_db.execQuery(strSQL);
 
@@ -858,6 +870,9 @@ bool WizIndex::deleteDocumentsTagsByLocation(const CString& strLocation)
         );
     bool bRet = execSQL(strSQL);
 
+    // bulk delete, counters are reloaded on demand
+    resetDocumentCount();
+
     if (!bRet)
         return false;
 
@@ -879,11 +894,23 @@ bool WizIndex::deleteDocumentsByLocation(const CString& strLocation)
 	}
 
 	CString strSQL;
+    if (isDocumentFtsEnabled()) {
+        strSQL.format("delete from WIZ_DOCUMENT_FTS where docid in \
+(select rowid from WIZ_DOCUMENT where DOCUMENT_LOCATION like '%s%%')",
+            strLocation.utf16()
+            );
+
+        execSQL(strSQL);
+    }
+
     strSQL.format("delete from WIZ_DOCUMENT where DOCUMENT_LOCATION like '%s%%'",
         strLocation.utf16()
         );
 
-    return execSQL(strSQL);
+    bool bRet = execSQL(strSQL);
+    resetDocumentCount();
+
+    return bRet;
 }
 
 bool WizIndex::updateDocumentInfoMD5(WIZDOCUMENTDATA& data)
@@ -925,8 +952,19 @@ bool WizIndex::deleteDocumentTags(WIZDOCUMENTDATA& data, bool bReset /* = true *
         STR2SQL(data.strGUID).utf16()
         );
 
-	if (!execSQL(strSQL))
-        return false;
+    {
+        WizDocumentCountWriter writer(*this);
+
+        // tags are counted before rows are deleted
+        if (isDocumentCounted(data.strGUID)) {
+            updateDocumentTagsCount(data.strGUID, -1);
+        }
+
+        if (!execSQL(strSQL)) {
+            resetDocumentCount();
+            return false;
+        }
+    }
 
     bool bRet = true;
 
@@ -985,10 +1023,16 @@ bool WizIndex::deleteTagDocuments(const WIZTAGDATA& data, bool bReset)
         STR2SQL(data.strGUID).utf16()
         );
 
-    if (!execSQL(strSQL)) {
-        TOLOG1("Failed to delete documents of tag: %1", data.strName);
-        return false;
-	}
+    {
+        WizDocumentCountWriter writer(*this);
+
+        if (!execSQL(strSQL)) {
+            TOLOG1("Failed to delete documents of tag: %1", data.strName);
+            return false;
+        }
+
+        removeTagDocumentCount(data.strGUID);
+    }
 
     if (bReset) {
         updateDocumentsInfoMD5(arrayDocument);
@@ -1047,11 +1091,23 @@ bool WizIndex::setDocumentTags(WIZDOCUMENTDATA& data,
 
 bool WizIndex::getDocumentTags(const CString& strDocumentGUID, CWizStdStringArray& arrayTagGUID)
 {
-    CString strWhere = WizFormatString1("DOCUMENT_GUID='%1'", strDocumentGUID);
-	CString strSQL = formatQuerySQL(TABLE_NAME_WIZ_DOCUMENT_TAG, FIELD_LIST_WIZ_DOCUMENT_TAG, strWhere); 
+    CString strSQL = formatQuerySQL(TABLE_NAME_WIZ_DOCUMENT_TAG, FIELD_LIST_WIZ_DOCUMENT_TAG, "DOCUMENT_GUID=?");
 
-    if (!sqlToStringArray(strSQL, 1, arrayTagGUID))
-        return false;
+    try
+    {
+        CppSQLite3CachedStatement stmt(m_db, strSQL);
+        stmt.bind(1, strDocumentGUID);
+        CppSQLite3Query query = stmt.execQuery();
+        while (!query.eof())
+        {
+            arrayTagGUID.push_back(query.getStringField(1));
+            query.nextRow();
+        }
+    }
+    catch (const CppSQLite3Exception& e)
+    {
+        return logSQLException(e, strSQL);
+    }
 
     size_t tagCount = arrayTagGUID.size();
     if (tagCount == 0)
@@ -1261,8 +1317,16 @@ bool WizIndex::insertDocumentTag(WIZDOCUMENTDATA& data,
         STR2SQL(strTagGUID).utf16()
         );
 
-    if (!execSQL(strSQL))
-        return false;
+    {
+        WizDocumentCountWriter writer(*this);
+
+        if (!execSQL(strSQL))
+            return false;
+
+        if (isDocumentCounted(data.strGUID)) {
+            updateTagDocumentCount(strTagGUID, 1);
+        }
+    }
 
     bool bRet = true;
     if (bReset)
@@ -1288,9 +1352,22 @@ bool WizIndex::deleteDocumentTag(WIZDOCUMENTDATA& data, const CString& strTagGUI
 
     CString strSQL = WizFormatString1("delete from WIZ_DOCUMENT_TAG where %1", strWhere);
 
-    bool bRet = execSQL(strSQL)
-		&& updateDocumentInfoMD5(data);
-	if (!bRet)
+    {
+        WizDocumentCountWriter writer(*this);
+
+        int nRowsChanged = 0;
+        try {
+            nRowsChanged = m_db.execDML(strSQL);
+        } catch (const CppSQLite3Exception& e) {
+            return logSQLException(e, strSQL);
+        }
+
+        if (nRowsChanged > 0 && isDocumentCounted(data.strGUID)) {
+            updateTagDocumentCount(strTagGUID, -1);
+        }
+    }
+
+    if (!updateDocumentInfoMD5(data))
         return false;
 
     Q_EMIT documentTagModified(data);
@@ -1326,15 +1403,20 @@ bool WizIndex::getMeta(CString strMetaName, CString strKey, CString& strValue, \
 	strMetaName.makeUpper();
 	strKey.makeUpper();
 
-    CString strWhere = WizFormatString2("META_NAME=%1 and META_KEY=%2",
-		STR2SQL(strMetaName),
-		STR2SQL(strKey)
-		);
-
-	CString strSQL = formatQuerySQL(TABLE_NAME_WIZ_META, FIELD_LIST_WIZ_META, strWhere); 
+	CString strSQL = formatQuerySQL(TABLE_NAME_WIZ_META, FIELD_LIST_WIZ_META, "META_NAME=? and META_KEY=?");
 
 	CWizMetaDataArray arrayMeta;
-    if (!sqlToMetaDataArray(strSQL, arrayMeta)) {
+    try
+    {
+        CppSQLite3CachedStatement stmt(m_db, strSQL);
+        stmt.bind(1, strMetaName);
+        stmt.bind(2, strKey);
+        CppSQLite3Query query = stmt.execQuery();
+        queryToMetaDataArray(query, arrayMeta);
+    }
+    catch (const CppSQLite3Exception& e)
+    {
+        logSQLException(e, strSQL);
         TOLOG1("Failed tog get meta: %1", strMetaName);
         return false;
 	}
@@ -1380,32 +1462,34 @@ bool WizIndex::setMeta(CString strMetaName, CString strKey, const CString& strVa
 
 	CString strSQL;
     if (bMetaExists) {
-        strSQL.format("update WIZ_META set META_VALUE=%s where META_NAME=%s and META_KEY=%s",
-            STR2SQL(strValue).utf16(),
-            STR2SQL(strMetaName).utf16(),
-            STR2SQL(strKey).utf16()
-			);
+        strSQL = "update WIZ_META set META_VALUE=? where META_NAME=? and META_KEY=?";
     } else {
-		CString strFormat = formatInsertSQLFormat(TABLE_NAME_WIZ_META, FIELD_LIST_WIZ_META, PARAM_LIST_WIZ_META);
-
-		strSQL.format(strFormat,
-            STR2SQL(strMetaName).utf16(),
-            STR2SQL(strKey).utf16(),
-            STR2SQL(strValue).utf16(),
-            TIME2SQL(WizGetCurrentTime()).utf16()
-			);
+        strSQL = formatStatementSQL(formatInsertSQLFormat(TABLE_NAME_WIZ_META, FIELD_LIST_WIZ_META, PARAM_LIST_WIZ_META));
 	}
 
-    if (!execSQL(strSQL)) {
+    try
+    {
+        CppSQLite3CachedStatement stmt(m_db, strSQL);
+        if (bMetaExists) {
+            stmt.bind(1, strValue);
+            stmt.bind(2, strMetaName);
+            stmt.bind(3, strKey);
+        } else {
+            stmt.bind(1, strMetaName);
+            stmt.bind(2, strKey);
+            stmt.bind(3, strValue);
+            stmt.bind(4, WizGetCurrentTime());
+        }
+        stmt.execDML();
+    }
+    catch (const CppSQLite3Exception& e)
+    {
+        logSQLException(e, strSQL);
         TOLOG3("Failed to update meta, meta name= %1, meta key = %2, meta value = %3", strMetaName, strKey, strValue);
         return false;
 	}
 
-	WIZMETADATA data;
-	data.strName = strMetaName;
-	data.strKey = strKey;
-    data.strValue = strValue;
-	data.tModified = WizGetCurrentTime();
+    notifyMetaModified(strMetaName, strKey, strValue);
 
     return true;
 }
@@ -1437,9 +1521,7 @@ bool WizIndex::getDocumentsNoTag(CWizDocumentDataArray& arrayDocument, bool incl
     if (includeTrash) {
         strWhere = "DOCUMENT_GUID not in (select distinct DOCUMENT_GUID from WIZ_DOCUMENT_TAG)";
     } else {
-        strWhere.format("DOCUMENT_GUID not in (select distinct DOCUMENT_GUID from WIZ_DOCUMENT_TAG) and DOCUMENT_LOCATION not like %s",
-                        STR2SQL(m_strDeletedItemsLocation + "%").utf16()
-                        );
+        strWhere = "DOCUMENT_GUID not in (select distinct DOCUMENT_GUID from WIZ_DOCUMENT_TAG) and DOCUMENT_IN_TRASH=0";
     }
 
     QString strSQL = formatQuerySQL(TABLE_NAME_WIZ_DOCUMENT, FIELD_LIST_WIZ_DOCUMENT, strWhere);
@@ -1450,8 +1532,7 @@ bool WizIndex::getDocumentsNoTag(CWizDocumentDataArray& arrayDocument, bool incl
 bool WizIndex::getLastestDocuments(CWizDocumentDataArray& arrayDocument, int nMax)
 {
     CString strExt;
-    strExt.format("where DOCUMENT_LOCATION not like %s order by DT_MODIFIED desc limit 0, %s",
-                  STR2SQL(m_strDeletedItemsLocation + "%").utf16(),
+    strExt.format("where DOCUMENT_IN_TRASH=0 order by DT_MODIFIED desc limit 0, %s",
                   WizIntToStr(nMax).utf16());
     QString strSQL = formatCanonicSQL(TABLE_NAME_WIZ_DOCUMENT, FIELD_LIST_WIZ_DOCUMENT, strExt);
     return sqlToDocumentDataArray(strSQL, arrayDocument);
@@ -1474,9 +1555,8 @@ bool WizIndex::getDocumentsByTag(const CString& strLocation,
                             STR2SQL(data.strGUID).utf16()
                             );
         } else {
-            strWhere.format("DOCUMENT_GUID in (select DOCUMENT_GUID from WIZ_DOCUMENT_TAG where TAG_GUID=%s) and DOCUMENT_LOCATION not like %s",
-                            STR2SQL(data.strGUID).utf16(),
-                            STR2SQL(m_strDeletedItemsLocation + "%").utf16()
+            strWhere.format("DOCUMENT_GUID in (select DOCUMENT_GUID from WIZ_DOCUMENT_TAG where TAG_GUID=%s) and DOCUMENT_IN_TRASH=0",
+                            STR2SQL(data.strGUID).utf16()
                             );
         }
 	}
@@ -1489,9 +1569,8 @@ bool WizIndex::getDocumentsByTag(const CString& strLocation,
 bool WizIndex::getDocumentsSizeByTag(const WIZTAGDATA& data, int& size)
 {
     CString strWhere;
-    strWhere.format("DOCUMENT_GUID in (select DOCUMENT_GUID from WIZ_DOCUMENT_TAG where TAG_GUID=%s) and DOCUMENT_LOCATION not like %s",
-                    STR2SQL(data.strGUID).utf16(),
-                    STR2SQL(m_strDeletedItemsLocation + "%").utf16()
+    strWhere.format("DOCUMENT_GUID in (select DOCUMENT_GUID from WIZ_DOCUMENT_TAG where TAG_GUID=%s) and DOCUMENT_IN_TRASH=0",
+                    STR2SQL(data.strGUID).utf16()
                     );
 
     CString strSQL = formatQuerySQL(TABLE_NAME_WIZ_DOCUMENT, "COUNT(*)", strWhere);
@@ -1689,7 +1768,10 @@ bool WizIndex::changeDocumentsLocation(const CString& strOldLocation, const CStr
         STR2SQL(strOldLocation).utf16()
 		);
 
-	return execSQL(strSQL);
+    bool bRet = execSQL(strSQL);
+    resetDocumentCount();
+
+    return bRet;
 }
 
 #ifndef WIZ_NO_OBSOLETE
@@ -2105,32 +2187,39 @@ bool WizIndex::searchDocumentByTitle(const QString& strTitle,
     if (listTitle.isEmpty())
         return false;
 
-    CString strWhere = WizFormatString1(" DOCUMENT_TITLE like '%%1%'", listTitle.first());
+    CString strWhereLike = " DOCUMENT_TITLE like " + STR2SQL_LIKE_BOTH(listTitle.first());
     for (int i = 1; i < listTitle.count(); i++) {
-        strWhere += WizFormatString1(" AND DOCUMENT_TITLE like '%%1%'", listTitle.at(i));
+        strWhereLike += " AND DOCUMENT_TITLE like " + STR2SQL_LIKE_BOTH(listTitle.at(i));
     }
 
+    CString strWhereLocation;
     if (!strLocation.isEmpty()) {
-        CString strWhereLocation;
         if (bIncludeSubFolders) {
             strWhereLocation = " AND DOCUMENT_LOCATION like " + STR2SQL(WizFormatString1("%%1%", strLocation));
         } else {
             strWhereLocation = " AND DOCUMENT_LOCATION like " + STR2SQL(WizFormatString1("%%1", strLocation));
         }
+    }
 
-        strWhere += strWhereLocation;
+    if (!isDocumentFtsEnabled()) {
+        return searchDocumentByWhere(strWhereLike + strWhereLocation, nMaxCount, arrayDocument);
     }
 
-    CString strSQL = formatQuerySQL(TABLE_NAME_WIZ_DOCUMENT, FIELD_LIST_WIZ_DOCUMENT, strWhere);
+    // title, keywords, author and url by fts index instead of scanning all documents
+    CString strMatch = documentFtsMatch(strTitle);
+    if (strMatch.isEmpty())
+        return true;
 
-    if (!sqlToDocumentDataArray(strSQL, arrayDocument))
+    CString strWhereFts = WizFormatString1(" rowid in (select docid from WIZ_DOCUMENT_FTS where WIZ_DOCUMENT_FTS match %1)", strMatch);
+    if (!searchDocumentByWhere(strWhereFts + strWhereLocation, nMaxCount, arrayDocument))
         return false;
 
-    if (arrayDocument.size() > nMaxCount) {
-        arrayDocument.resize(nMaxCount);
-    }
+    // fts only matches latin words by prefix. titles are scanned for keywords
+    // inside a word ("port" in "report") only if fts found nothing at all
+    if (!arrayDocument.empty() || !documentFtsHasLatin(strTitle))
+        return true;
 
-    return true;
+    return searchDocumentByWhere(strWhereLike + strWhereLocation, nMaxCount, arrayDocument);
 }
 
 CString URLToSQL(const CString& strURL)
@@ -2679,7 +2768,7 @@ bool WizIndex::getRecentDocumentsByCreatedTime(const WizOleDateTime& t, CWizDocu
     CString strTime = TIME2SQL(t);
 
     CString strSQL;
-    strSQL.format("select %s from %s where DOCUMENT_LOCATION not like '/Deleted Items/%%' and DT_CREATED>=%s order by DT_CREATED desc",
+    strSQL.format("select %s from %s where DOCUMENT_IN_TRASH=0 and DT_CREATED>=%s order by DT_CREATED desc",
         QString(FIELD_LIST_WIZ_DOCUMENT).utf16(),
         QString(TABLE_NAME_WIZ_DOCUMENT).utf16(),
         strTime.utf16()
@@ -2693,7 +2782,7 @@ bool WizIndex::getRecentDocumentsByModifiedTime(const WizOleDateTime& t, CWizDoc
     CString strTime = TIME2SQL(t);
 
     CString strSQL;
-    strSQL.format("select %s from %s where DOCUMENT_LOCATION not like '/Deleted Items/%%' and DT_MODIFIED>=%s order by DT_MODIFIED desc",
+    strSQL.format("select %s from %s where DOCUMENT_IN_TRASH=0 and DT_MODIFIED>=%s order by DT_MODIFIED desc",
         QString(FIELD_LIST_WIZ_DOCUMENT).utf16(),
         QString(TABLE_NAME_WIZ_DOCUMENT).utf16(),
         strTime.utf16()
@@ -2707,7 +2796,7 @@ bool WizIndex::getRecentDocumentsByAccessedTime(const WizOleDateTime& t, CWizDoc
     CString strTime = TIME2SQL(t);
 
     CString strSQL;
-    strSQL.format("select %s from %s where DOCUMENT_LOCATION not like '/Deleted Items/%%' and DT_ACCESSED>=%s order by DT_ACCESSED desc",
+    strSQL.format("select %s from %s where DOCUMENT_IN_TRASH=0 and DT_ACCESSED>=%s order by DT_ACCESSED desc",
         QString(FIELD_LIST_WIZ_DOCUMENT).utf16(),
         QString(TABLE_NAME_WIZ_DOCUMENT).utf16(),
         strTime.utf16()
@@ -2876,6 +2965,8 @@ bool WizIndex::deleteMetasByName(const QString& strMetaName)
     if (!execSQL(strSQL))
         return false;
 
+    notifyMetaDeleted(strMetaName.toUpper(), QString());
+
     return true;
 }
 
@@ -2887,6 +2978,8 @@ bool WizIndex::deleteMetaByKey(const QString& strMetaName, const QString& strMet
     if (!execSQL(strSQL))
         return false;
 
+    notifyMetaDeleted(strMetaName.toUpper(), strMetaKey.toUpper());
+
     return true;
 }
 
@@ -2947,9 +3040,7 @@ bool WizIndex::getDocumentsNoTagCount(int& nSize, bool includeTrash /* = false *
     if (includeTrash) {
         strWhere = "DOCUMENT_GUID not in (select distinct DOCUMENT_GUID from WIZ_DOCUMENT_TAG)";
     } else {
-        strWhere.format("DOCUMENT_GUID not in (select distinct DOCUMENT_GUID from WIZ_DOCUMENT_TAG) and DOCUMENT_LOCATION not like %s",
-                        STR2SQL(m_strDeletedItemsLocation + "%").utf16()
-                        );
+        strWhere = "DOCUMENT_GUID not in (select distinct DOCUMENT_GUID from WIZ_DOCUMENT_TAG) and DOCUMENT_IN_TRASH=0";
     }
 
     QString strSQL = formatQuerySQL(TABLE_NAME_WIZ_DOCUMENT, "COUNT(*)", strWhere);
@@ -2960,62 +3051,24 @@ bool WizIndex::getDocumentsNoTagCount(int& nSize, bool includeTrash /* = false *
 
 bool WizIndex::getAllTagsDocumentCount(std::map<CString, int>& mapTagDocumentCount)
 {
-	CString strSQL;
-    strSQL.format("select TAG_GUID, count(*) from WIZ_DOCUMENT_TAG where DOCUMENT_GUID in (select distinct DOCUMENT_GUID from WIZ_DOCUMENT where DOCUMENT_LOCATION not like '/Deleted Items/%%') group by TAG_GUID"
-		);
-	try
-	{
-		CppSQLite3Query query = m_db.execQuery(strSQL);
-
-		while (!query.eof())
-		{
-            CString strTagGUID = query.getStringField(0);
-			int nDocumentCount = query.getIntField(1);
-
-			mapTagDocumentCount[strTagGUID] = nDocumentCount;
-
-			query.nextRow();
-		}
-        return true;
-	}
-	catch (const CppSQLite3Exception& e)
-	{
-		return logSQLException(e, strSQL);
-	}
-    return true;
+    return getTagsDocumentCount(mapTagDocumentCount);
 }
 
 bool WizIndex::getAllLocationsDocumentCount(std::map<CString, int>& mapLocationDocumentCount)
 {
-	CString strSQL;
-    strSQL.format("select DOCUMENT_LOCATION, count(*) as DOCUMENT_COUNT from WIZ_DOCUMENT group by DOCUMENT_LOCATION");
-	try
-	{
-		CppSQLite3Query query = m_db.execQuery(strSQL);
-		while (!query.eof())
-		{
-            CString strLocation = query.getStringField(0);
-			int nDocumentCount = query.getIntField(1);
-			mapLocationDocumentCount[strLocation] = nDocumentCount;
-			query.nextRow();
-		}
-        return true;
-	}
-	catch (const CppSQLite3Exception& e)
-	{
-        TOLOG(strSQL);
-		return logSQLException(e, strSQL);
-	}
-
-    return true;
+    return getLocationsDocumentCount(mapLocationDocumentCount);
 }
 
 int WizIndex::getTrashDocumentCount()
 {
-    int nTotal = 0;
+    int nTotal = getTrashDocumentCountFromCache();
+    if (nTotal >= 0)
+        return nTotal;
+
+    nTotal = 0;
 
     CString strSQL;
-    strSQL.format("select count(*) as DOCUMENT_COUNT from WIZ_DOCUMENT where DOCUMENT_LOCATION like '/Deleted Items/%'");
+    strSQL = "select count(*) as DOCUMENT_COUNT from WIZ_DOCUMENT where DOCUMENT_IN_TRASH=1";
     try
     {
         CppSQLite3Query query = m_db.execQuery(strSQL);
@@ -3141,19 +3194,28 @@ bool WizIndex::setAllDocumentsSearchIndexed(bool b)
 
 bool WizIndex::setDocumentSearchIndexed(const QString& strDocumentGUID, bool b)
 {
-    CString strSQL = WizFormatString2("update WIZ_DOCUMENT set DOCUMENT_INDEXED=%1 where DOCUMENT_GUID=%2",
-        b ? "1" : "0",
-        STR2SQL(strDocumentGUID));
+    CString strSQL = "update WIZ_DOCUMENT set DOCUMENT_INDEXED=? where DOCUMENT_GUID=?";
 
-	if (!execSQL(strSQL))
-        return false;
-
-    return true;
+    try
+    {
+        CppSQLite3CachedStatement stmt(m_db, strSQL);
+        stmt.bind(1, b ? 1 : 0);
+        stmt.bind(2, strDocumentGUID);
+        stmt.execDML();
+        return true;
+    }
+    catch (const CppSQLite3Exception& e)
+    {
+        return logSQLException(e, strSQL);
+    }
 }
 
 bool WizIndex::searchDocumentByWhere(const QString& strWhere, int nMaxCount, CWizDocumentDataArray& arrayDocument)
 {
     CString strSQL = formatQuerySQL(TABLE_NAME_WIZ_DOCUMENT, FIELD_LIST_WIZ_DOCUMENT, strWhere);
+    if (nMaxCount > 0) {
+        strSQL += WizFormatString1(" limit %1", WizIntToStr(nMaxCount));
+    }
 
     if (!sqlToDocumentDataArray(strSQL, arrayDocument))
         return false;
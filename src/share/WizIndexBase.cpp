@@ -2,13 +2,34 @@
 #include "WizDef.h"
 
 #include <QDebug>
+#include <QThread>
 
 #include "utils/WizLogger.h"
 #include "utils/WizPathResolve.h"
 
+// list, search, thumbnail and sync threads may read at the same time
+#define WIZ_INDEX_READ_CONNECTION_MAX   4
+
+// documents kept by documentFromGuid / documentsFromGuids
+#define WIZ_INDEX_DOCUMENT_CACHE_MAX    5000
+// guids in one "in (...)" query
+#define WIZ_INDEX_DOCUMENT_BATCH_MAX    500
+// longest a batch transaction keeps other writers waiting
+#define WIZ_INDEX_TRANSACTION_SLICE_MSECS   100
+
+// rowid is used to find cached document in sqlite update hook
+#define FIELD_LIST_WIZ_DOCUMENT_CACHE   FIELD_LIST_WIZ_DOCUMENT ", rowid"
+#define documentROWID                   (documentDATA_CHANGED + 1)
+
 
 WizIndexBase::WizIndexBase(void)
     : m_bUpdating(false)
+    , m_bDocumentFts(false)
+    , m_mutexDocumentCount(QMutex::Recursive)
+    , m_bDocumentCountLoaded(false)
+    , m_cacheDocument(WIZ_INDEX_DOCUMENT_CACHE_MAX)
+    , m_nDocumentCacheGeneration(0)
+    , m_bDocumentCacheDirty(false)
 {
     qRegisterMetaType<WIZTAGDATA>("WIZTAGDATA");
     qRegisterMetaType<WIZSTYLEDATA>("WIZSTYLEDATA");
@@ -31,6 +52,7 @@ bool WizIndexBase::open(const CString& strFileName)
 
     try {
         m_db.open(strFileName);
+        sqlite3_update_hook(m_db.handle(), documentUpdateHook, this);
         // upgrade table structure if table structure have been changed
         if (m_db.tableExists(TABLE_NAME_WIZ_META)) {
             int nVersion = getTableStructureVersion().toInt();
@@ -48,6 +70,12 @@ bool WizIndexBase::open(const CString& strFileName)
     }
     setTableStructureVersion(WIZ_TABLE_STRUCTURE_VERSION);
 
+    if (!checkIndex())
+        return false;
+
+    // optional, search falls back to like if sqlite is built without fts
+    m_bDocumentFts = checkDocumentFts();
+
     return true;
 }
 
@@ -58,7 +86,10 @@ bool WizIndexBase::isOpened()
 
 void WizIndexBase::close()
 {
+    closeReadConnections();
     m_db.close();
+    resetDocumentCount();
+    clearDocumentCache();
 }
 
 bool WizIndexBase::checkTable(const QString& strTableName)
@@ -76,6 +107,156 @@ bool WizIndexBase::checkTable(const QString& strTableName)
     return result;
 }
 
+bool WizIndexBase::checkIndex()
+{
+    // indexes and triggers are created with "if not exists"
+    CString strFileName = WizPathAddBackslash2(Utils::WizPathResolve::resourcesPath() + "sql") + "wiz_index.sql";
+    CString strSQL;
+    if (!WizLoadUnicodeTextFromFile(strFileName, strSQL))
+        return false;
+
+    return execSQL(strSQL);
+}
+
+bool WizIndexBase::checkDocumentFts()
+{
+    if (m_db.tableExists(TABLE_NAME_WIZ_DOCUMENT_FTS))
+        return true;
+
+    if (!checkTable(TABLE_NAME_WIZ_DOCUMENT_FTS)) {
+        TOLOG("Document fts is not available, search title by like");
+        return false;
+    }
+
+    // fill existing documents
+    try {
+        CString strSQL = formatQuerySQL(TABLE_NAME_WIZ_DOCUMENT, "rowid, " FIELD_LIST_WIZ_DOCUMENT_FTS);
+        CppSQLite3Query query = m_db.execQuery(strSQL);
+
+        m_db.beginTransaction();
+        while (!query.eof()) {
+            CString strInsert;
+            strInsert.format("insert into " TABLE_NAME_WIZ_DOCUMENT_FTS " (docid, " FIELD_LIST_WIZ_DOCUMENT_FTS ") values (%s, %s, %s, %s, %s)",
+                WizInt64ToStr(query.getInt64Field(0)).utf16(),
+                STR2SQL(documentFtsText(query.getStringField(1))).utf16(),
+                STR2SQL(documentFtsText(query.getStringField(2))).utf16(),
+                STR2SQL(documentFtsText(query.getStringField(3))).utf16(),
+                STR2SQL(documentFtsText(query.getStringField(4))).utf16());
+
+            m_db.execDML(strInsert);
+            query.nextRow();
+        }
+        m_db.commitTransaction();
+    } catch (const CppSQLite3Exception& e) {
+        logSQLException(e, "fill document fts");
+        rollbackTransaction();
+        execSQL("drop table " TABLE_NAME_WIZ_DOCUMENT_FTS);
+        return false;
+    }
+
+    return true;
+}
+
+static bool isFtsSeparatedChar(const QChar& ch)
+{
+    // CJK radicals, kana, CJK ideographs, hangul and fullwidth forms have no word boundary
+    ushort c = ch.unicode();
+    return (c >= 0x2E80 && c <= 0x9FFF)
+            || (c >= 0xAC00 && c <= 0xD7AF)
+            || (c >= 0xF900 && c <= 0xFAFF)
+            || (c >= 0xFF00 && c <= 0xFFEF);
+}
+
+CString WizIndexBase::documentFtsText(const QString& strText)
+{
+    QString strLower = strText.toLower();
+
+    CString strRet;
+    strRet.reserve(strLower.length() * 2);
+    for (int i = 0; i < strLower.length(); i++) {
+        const QChar& ch = strLower.at(i);
+        if (isFtsSeparatedChar(ch)) {
+            strRet += ' ';
+            strRet += ch;
+            strRet += ' ';
+        } else {
+            strRet += ch;
+        }
+    }
+
+    return strRet;
+}
+
+CString WizIndexBase::documentFtsMatch(const QString& strKeywords)
+{
+    QStringList listKeyword = strKeywords.split(getWizSearchSplitChar(), QString::SkipEmptyParts);
+
+    // every keyword is a phrase: CJK characters must be adjacent, last latin word is a prefix
+    QStringList listPhrase;
+    foreach (const QString& strKeyword, listKeyword) {
+        QString strText = documentFtsText(strKeyword);
+        // query syntax characters
+        foreach (const QChar& ch, QString("\"*^:()")) {
+            strText.replace(ch, ' ');
+        }
+
+        QStringList listToken = strText.split(' ', QString::SkipEmptyParts);
+        if (listToken.isEmpty())
+            continue;
+
+        if (!isFtsSeparatedChar(listToken.last().at(0))) {
+            listToken.last().append('*');
+        }
+
+        listPhrase.append("\"" + listToken.join(" ") + "\"");
+    }
+
+    if (listPhrase.isEmpty())
+        return CString();
+
+    return STR2SQL(listPhrase.join(" "));
+}
+
+bool WizIndexBase::documentFtsHasLatin(const QString& strKeywords)
+{
+    foreach (const QChar& ch, strKeywords) {
+        if (ch.isLetterOrNumber() && !isFtsSeparatedChar(ch))
+            return true;
+    }
+
+    return false;
+}
+
+bool WizIndexBase::updateDocumentFts(const WIZDOCUMENTDATA& data)
+{
+    if (!m_bDocumentFts)
+        return true;
+
+    CString strSQL;
+    strSQL.format("insert or replace into " TABLE_NAME_WIZ_DOCUMENT_FTS " (docid, " FIELD_LIST_WIZ_DOCUMENT_FTS ") \
+select rowid, %s, %s, %s, %s from " TABLE_NAME_WIZ_DOCUMENT " where DOCUMENT_GUID=%s",
+        STR2SQL(documentFtsText(data.strTitle)).utf16(),
+        STR2SQL(documentFtsText(data.strKeywords)).utf16(),
+        STR2SQL(documentFtsText(data.strAuthor)).utf16(),
+        STR2SQL(documentFtsText(data.strURL)).utf16(),
+        STR2SQL(data.strGUID).utf16());
+
+    return execSQL(strSQL);
+}
+
+bool WizIndexBase::deleteDocumentFts(const CString& strDocumentGUID)
+{
+    if (!m_bDocumentFts)
+        return true;
+
+    CString strSQL;
+    strSQL.format("delete from " TABLE_NAME_WIZ_DOCUMENT_FTS " where docid in \
+(select rowid from " TABLE_NAME_WIZ_DOCUMENT " where DOCUMENT_GUID=%s)",
+        STR2SQL(strDocumentGUID).utf16());
+
+    return execSQL(strSQL);
+}
+
 bool WizIndexBase::execSQL(const CString& strSQL)
 {
     try {
@@ -127,6 +308,323 @@ bool WizIndexBase::getFirstRowFieldValue(const CString& strSQL, int nFieldIndex,
     }
 }
 
+bool WizIndexBase::beginTransaction()
+{
+    try {
+        m_db.beginTransaction();
+        return true;
+    } catch (const CppSQLite3Exception& e) {
+        return logSQLException(e, "begin transaction");
+    }
+}
+
+bool WizIndexBase::commitTransaction()
+{
+    try {
+        bool bCommitted = m_db.commitTransaction();
+        // nested transaction may be rolled back by commit
+        clearDocumentCacheIfDirty();
+        if (!bCommitted) {
+            resetDocumentCount();
+        }
+        if (!m_db.isTransactionOwner()) {
+            endPendingMeta(bCommitted);
+        }
+        return bCommitted;
+    } catch (const CppSQLite3Exception& e) {
+        // changes are rolled back, counts of them are not right anymore
+        resetDocumentCount();
+        clearDocumentCacheIfDirty();
+        endPendingMeta(false);
+        return logSQLException(e, "commit transaction");
+    }
+}
+
+bool WizIndexBase::yieldTransaction()
+{
+    try {
+        if (m_db.yieldTransaction(WIZ_INDEX_TRANSACTION_SLICE_MSECS)) {
+            clearDocumentCacheIfDirty();
+            endPendingMeta(true);
+        }
+        return true;
+    } catch (const CppSQLite3Exception& e) {
+        resetDocumentCount();
+        clearDocumentCacheIfDirty();
+        endPendingMeta(false);
+        return logSQLException(e, "yield transaction");
+    }
+}
+
+bool WizIndexBase::rollbackTransaction()
+{
+    resetDocumentCount();
+    clearDocumentCacheIfDirty();
+
+    try {
+        m_db.rollbackTransaction();
+    } catch (const CppSQLite3Exception& e) {
+        endPendingMeta(false);
+        return logSQLException(e, "rollback transaction");
+    }
+
+    // nested one is dropped by commit of outermost transaction
+    if (!m_db.isTransactionOwner()) {
+        endPendingMeta(false);
+    }
+    return true;
+}
+
+void WizIndexBase::notifyMetaModified(const QString& strMetaName, const QString& strKey, const QString& strValue)
+{
+    if (m_db.isTransactionOwner()) {
+        WizPendingMeta meta = {QThread::currentThreadId(), false, strMetaName, strKey, strValue};
+        QMutexLocker locker(&m_mutexPendingMeta);
+        m_listPendingMeta.append(meta);
+        return;
+    }
+
+    Q_EMIT metaModified(strMetaName, strKey, strValue);
+}
+
+void WizIndexBase::notifyMetaDeleted(const QString& strMetaName, const QString& strKey)
+{
+    if (m_db.isTransactionOwner()) {
+        WizPendingMeta meta = {QThread::currentThreadId(), true, strMetaName, strKey, QString()};
+        QMutexLocker locker(&m_mutexPendingMeta);
+        m_listPendingMeta.append(meta);
+        return;
+    }
+
+    Q_EMIT metaDeleted(strMetaName, strKey);
+}
+
+void WizIndexBase::endPendingMeta(bool bCommitted)
+{
+    // another thread may have begun its transaction already
+    QList<WizPendingMeta> listMeta;
+    {
+        QMutexLocker locker(&m_mutexPendingMeta);
+        Qt::HANDLE threadId = QThread::currentThreadId();
+        QList<WizPendingMeta>::iterator it = m_listPendingMeta.begin();
+        while (it != m_listPendingMeta.end()) {
+            if (it->threadId == threadId) {
+                listMeta.append(*it);
+                it = m_listPendingMeta.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    if (!bCommitted)
+        return;
+
+    foreach (const WizPendingMeta& meta, listMeta) {
+        if (meta.bDeleted) {
+            Q_EMIT metaDeleted(meta.strMetaName, meta.strKey);
+        } else {
+            Q_EMIT metaModified(meta.strMetaName, meta.strKey, meta.strValue);
+        }
+    }
+}
+
+CppSQLite3DB* WizIndexBase::acquireReadConnection()
+{
+    // without wal, readers would block the writer
+    if (!m_db.isWalEnabled() || m_db.isTransactionOwner())
+        return &m_db;
+
+    QMutexLocker locker(&m_mutexReadConnection);
+    if (!m_arrayFreeReadConnection.isEmpty())
+        return m_arrayFreeReadConnection.takeLast();
+
+    if (m_arrayReadConnection.size() >= WIZ_INDEX_READ_CONNECTION_MAX)
+        return &m_db;
+
+    CppSQLite3DB* db = new CppSQLite3DB();
+    try {
+        db->open(m_strFileName, true);
+    } catch (const CppSQLite3Exception& e) {
+        logSQLException(e, "open read connection");
+        delete db;
+        return &m_db;
+    }
+
+    m_arrayReadConnection.append(db);
+    return db;
+}
+
+void WizIndexBase::releaseReadConnection(CppSQLite3DB* db)
+{
+    if (db == &m_db)
+        return;
+
+    QMutexLocker locker(&m_mutexReadConnection);
+    m_arrayFreeReadConnection.append(db);
+}
+
+void WizIndexBase::closeReadConnections()
+{
+    QMutexLocker locker(&m_mutexReadConnection);
+    foreach (CppSQLite3DB* db, m_arrayReadConnection) {
+        db->close();
+        delete db;
+    }
+    m_arrayReadConnection.clear();
+    m_arrayFreeReadConnection.clear();
+}
+
+bool WizIndexBase::loadDocumentCount()
+{
+    std::map<CString, int> mapLocation;
+    std::map<CString, int> mapTag;
+
+    CString strSQL = "select DOCUMENT_LOCATION, count(*) from WIZ_DOCUMENT group by DOCUMENT_LOCATION";
+    try {
+        CppSQLite3Query query = m_db.execQuery(strSQL);
+        while (!query.eof()) {
+            mapLocation[query.getStringField(0)] = query.getIntField(1);
+            query.nextRow();
+        }
+    } catch (const CppSQLite3Exception& e) {
+        return logSQLException(e, strSQL);
+    }
+
+    strSQL = "select TAG_GUID, count(*) from WIZ_DOCUMENT_TAG where DOCUMENT_GUID in (select DOCUMENT_GUID from WIZ_DOCUMENT where DOCUMENT_IN_TRASH=0) group by TAG_GUID";
+    try {
+        CppSQLite3Query query = m_db.execQuery(strSQL);
+        while (!query.eof()) {
+            mapTag[query.getStringField(0)] = query.getIntField(1);
+            query.nextRow();
+        }
+    } catch (const CppSQLite3Exception& e) {
+        return logSQLException(e, strSQL);
+    }
+
+    m_mapLocationDocumentCount.swap(mapLocation);
+    m_mapTagDocumentCount.swap(mapTag);
+    m_bDocumentCountLoaded = true;
+    return true;
+}
+
+bool WizIndexBase::getLocationsDocumentCount(std::map<CString, int>& mapLocationDocumentCount)
+{
+    QMutexLocker locker(&m_mutexDocumentCount);
+    if (!m_bDocumentCountLoaded && !loadDocumentCount())
+        return false;
+
+    mapLocationDocumentCount = m_mapLocationDocumentCount;
+    return true;
+}
+
+bool WizIndexBase::getTagsDocumentCount(std::map<CString, int>& mapTagDocumentCount)
+{
+    QMutexLocker locker(&m_mutexDocumentCount);
+    if (!m_bDocumentCountLoaded && !loadDocumentCount())
+        return false;
+
+    mapTagDocumentCount = m_mapTagDocumentCount;
+    return true;
+}
+
+int WizIndexBase::getTrashDocumentCountFromCache()
+{
+    QMutexLocker locker(&m_mutexDocumentCount);
+    if (!m_bDocumentCountLoaded)
+        return -1;
+
+    int nCount = 0;
+    std::map<CString, int>::const_iterator it;
+    for (it = m_mapLocationDocumentCount.begin(); it != m_mapLocationDocumentCount.end(); it++) {
+        if (isTrashLocation(it->first)) {
+            nCount += it->second;
+        }
+    }
+
+    return nCount;
+}
+
+void WizIndexBase::resetDocumentCount()
+{
+    QMutexLocker locker(&m_mutexDocumentCount);
+    m_bDocumentCountLoaded = false;
+    m_mapLocationDocumentCount.clear();
+    m_mapTagDocumentCount.clear();
+}
+
+void WizIndexBase::updateLocationDocumentCount(const QString& strLocation, int nDelta)
+{
+    QMutexLocker locker(&m_mutexDocumentCount);
+    if (!m_bDocumentCountLoaded)
+        return;
+
+    int& nCount = m_mapLocationDocumentCount[strLocation];
+    nCount += nDelta;
+    if (nCount <= 0) {
+        m_mapLocationDocumentCount.erase(strLocation);
+    }
+}
+
+void WizIndexBase::updateTagDocumentCount(const QString& strTagGUID, int nDelta)
+{
+    QMutexLocker locker(&m_mutexDocumentCount);
+    if (!m_bDocumentCountLoaded)
+        return;
+
+    int& nCount = m_mapTagDocumentCount[strTagGUID];
+    nCount += nDelta;
+    if (nCount <= 0) {
+        m_mapTagDocumentCount.erase(strTagGUID);
+    }
+}
+
+void WizIndexBase::updateDocumentTagsCount(const QString& strDocumentGUID, int nDelta)
+{
+    QMutexLocker locker(&m_mutexDocumentCount);
+    if (!m_bDocumentCountLoaded)
+        return;
+
+    CString strSQL = "select TAG_GUID from WIZ_DOCUMENT_TAG where DOCUMENT_GUID=?";
+    try {
+        CppSQLite3CachedStatement stmt(m_db, strSQL);
+        stmt.bind(1, strDocumentGUID);
+        CppSQLite3Query query = stmt.execQuery();
+        while (!query.eof()) {
+            updateTagDocumentCount(query.getStringField(0), nDelta);
+            query.nextRow();
+        }
+    } catch (const CppSQLite3Exception& e) {
+        logSQLException(e, strSQL);
+        resetDocumentCount();
+    }
+}
+
+void WizIndexBase::removeTagDocumentCount(const QString& strTagGUID)
+{
+    QMutexLocker locker(&m_mutexDocumentCount);
+    m_mapTagDocumentCount.erase(strTagGUID);
+}
+
+bool WizIndexBase::isDocumentCounted(const QString& strDocumentGUID)
+{
+    CString strSQL = "select DOCUMENT_IN_TRASH from WIZ_DOCUMENT where DOCUMENT_GUID=?";
+    try {
+        CppSQLite3CachedStatement stmt(m_db, strSQL);
+        stmt.bind(1, strDocumentGUID);
+        CppSQLite3Query query = stmt.execQuery();
+        return !query.eof() && query.getIntField(0) == 0;
+    } catch (const CppSQLite3Exception& e) {
+        return logSQLException(e, strSQL);
+    }
+}
+
+bool WizIndexBase::isTrashLocation(const QString& strLocation)
+{
+    // same as DOCUMENT_IN_TRASH, like is case insensitive
+    return strLocation.startsWith(LOCATION_DELETED_ITEMS, Qt::CaseInsensitive);
+}
+
 bool WizIndexBase::logSQLException(const CppSQLite3Exception& e, const CString& strSQL)
 {
     TOLOG(e.errorMessage());
@@ -160,6 +658,12 @@ bool WizIndexBase::updateTableStructure(int oldVersion)
         exec("ALTER TABLE 'WIZ_DOCUMENT' ADD 'DATA_CHANGED' int default 1;");
     }
     //
+    if (oldVersion < 5) {
+        // kept by triggers of wiz_index.sql afterwards
+        exec("ALTER TABLE 'WIZ_DOCUMENT' ADD 'DOCUMENT_IN_TRASH' int;");
+        exec("update WIZ_DOCUMENT set DOCUMENT_IN_TRASH=(DOCUMENT_LOCATION like '/Deleted Items/%');");
+    }
+    //
     setTableStructureVersion(WIZ_TABLE_STRUCTURE_VERSION);
     return true;
 }
@@ -237,6 +741,14 @@ CString WizIndexBase::formatDeleteSQLByWhere(const CString& strTableName, const
                             strWhere);
 }
 
+CString WizIndexBase::formatStatementSQL(const CString& strFormat)
+{
+    CString strSQL = strFormat;
+    strSQL.replace("%s", "?");
+    strSQL.replace("%d", "?");
+    return strSQL;
+}
+
 CString WizIndexBase::formatQuerySQLByTime(const CString& strTableName,
                                             const CString& strFieldList,
                                             const CString& strFieldName,
@@ -299,7 +811,8 @@ bool WizIndexBase::sqlToSize(const CString& strSQL, int& size)
 {
     try
     {
-        CppSQLite3Query query = m_db.execQuery(strSQL);
+        WizIndexReader reader(*this);
+        CppSQLite3Query query = reader.db().execQuery(strSQL);
         size = query.getInt64Field(0);
         return true;
     }
@@ -313,24 +826,9 @@ bool WizIndexBase::sqlToTagDataArray(const CString& strSQL, CWizTagDataArray& ar
 {
     try
     {
-        CppSQLite3Query query = m_db.execQuery(strSQL);
-        while (!query.eof())
-        {
-            WIZTAGDATA data;
-            data.strKbGUID = kbGUID();
-            data.strGUID = query.getStringField(tagTAG_GUID);
-            data.strParentGUID = query.getStringField(tagTAG_GROUP_GUID);
-            data.strName = query.getStringField(tagTAG_NAME);
-            data.strDescription = query.getStringField(tagTAG_DESCRIPTION);
-            data.tModified = query.getTimeField(tagDT_MODIFIED);
-            data.nVersion = query.getInt64Field(tagVersion);
-            data.nPostion = query.getInt64Field(tagTAG_POS);
-
-            arrayTag.push_back(data);
-            query.nextRow();
-        }
-
-        std::sort(arrayTag.begin(), arrayTag.end());
+        WizIndexReader reader(*this);
+        CppSQLite3Query query = reader.db().execQuery(strSQL);
+        queryToTagDataArray(query, arrayTag);
         return true;
     }
     catch (const CppSQLite3Exception& e)
@@ -339,11 +837,33 @@ bool WizIndexBase::sqlToTagDataArray(const CString& strSQL, CWizTagDataArray& ar
     }
 }
 
+void WizIndexBase::queryToTagDataArray(CppSQLite3Query& query, CWizTagDataArray& arrayTag)
+{
+    while (!query.eof())
+    {
+        WIZTAGDATA data;
+        data.strKbGUID = kbGUID();
+        data.strGUID = query.getStringField(tagTAG_GUID);
+        data.strParentGUID = query.getStringField(tagTAG_GROUP_GUID);
+        data.strName = query.getStringField(tagTAG_NAME);
+        data.strDescription = query.getStringField(tagTAG_DESCRIPTION);
+        data.tModified = query.getTimeField(tagDT_MODIFIED);
+        data.nVersion = query.getInt64Field(tagVersion);
+        data.nPostion = query.getInt64Field(tagTAG_POS);
+
+        arrayTag.push_back(data);
+        query.nextRow();
+    }
+
+    std::sort(arrayTag.begin(), arrayTag.end());
+}
+
 bool WizIndexBase::sqlToStyleDataArray(const CString& strSQL, CWizStyleDataArray& arrayStyle)
 {
     try
     {
-        CppSQLite3Query query = m_db.execQuery(strSQL);
+        WizIndexReader reader(*this);
+        CppSQLite3Query query = reader.db().execQuery(strSQL);
         while (!query.eof())
         {
             WIZSTYLEDATA data;
@@ -375,19 +895,9 @@ bool WizIndexBase::sqlToMetaDataArray(const CString& strSQL, CWizMetaDataArray&
 {
     try
     {
-        CppSQLite3Query query = m_db.execQuery(strSQL);
-        while (!query.eof())
-        {
-            WIZMETADATA data;
-            data.strKbGUID = kbGUID();
-            data.strName = query.getStringField(metaMETA_NAME);
-            data.strKey = query.getStringField(metaMETA_KEY);
-            data.strValue = query.getStringField(metaMETA_VALUE);
-            data.tModified = query.getTimeField(metaDT_MODIFIED);
-
-            arrayMeta.push_back(data);
-            query.nextRow();
-        }
+        WizIndexReader reader(*this);
+        CppSQLite3Query query = reader.db().execQuery(strSQL);
+        queryToMetaDataArray(query, arrayMeta);
         return true;
     }
     catch (const CppSQLite3Exception& e)
@@ -396,11 +906,28 @@ bool WizIndexBase::sqlToMetaDataArray(const CString& strSQL, CWizMetaDataArray&
     }
 }
 
+void WizIndexBase::queryToMetaDataArray(CppSQLite3Query& query, CWizMetaDataArray& arrayMeta)
+{
+    while (!query.eof())
+    {
+        WIZMETADATA data;
+        data.strKbGUID = kbGUID();
+        data.strName = query.getStringField(metaMETA_NAME);
+        data.strKey = query.getStringField(metaMETA_KEY);
+        data.strValue = query.getStringField(metaMETA_VALUE);
+        data.tModified = query.getTimeField(metaDT_MODIFIED);
+
+        arrayMeta.push_back(data);
+        query.nextRow();
+    }
+}
+
 bool WizIndexBase::sqlToDeletedGuidDataArray(const CString& strSQL, CWizDeletedGUIDDataArray& arrayGUID)
 {
     try
     {
-        CppSQLite3Query query = m_db.execQuery(strSQL);
+        WizIndexReader reader(*this);
+        CppSQLite3Query query = reader.db().execQuery(strSQL);
         while (!query.eof())
         {
             WIZDELETEDGUIDDATA data;
@@ -424,7 +951,8 @@ bool WizIndexBase::sqlToStringArray(const CString& strSQL, int nFieldIndex, CWiz
 {
     try
     {
-        CppSQLite3Query query = m_db.execQuery(strSQL);
+        WizIndexReader reader(*this);
+        CppSQLite3Query query = reader.db().execQuery(strSQL);
         while (!query.eof())
         {
             CString strGUID = query.getStringField(nFieldIndex);
@@ -445,39 +973,9 @@ bool WizIndexBase::sqlToDocumentDataArray(const CString& strSQL, CWizDocumentDat
 {
     try
     {
-        CppSQLite3Query query = m_db.execQuery(strSQL);
-        while (!query.eof())
-        {
-            WIZDOCUMENTDATA data;
-            data.strKbGUID = kbGUID();
-            data.strGUID = query.getStringField(documentDOCUMENT_GUID);
-            data.strTitle = query.getStringField(documentDOCUMENT_TITLE);
-            data.strLocation = query.getStringField(documentDOCUMENT_LOCATION);
-            data.strName = query.getStringField(documentDOCUMENT_NAME);
-            data.strSEO = query.getStringField(documentDOCUMENT_SEO);
-            data.strURL = query.getStringField(documentDOCUMENT_URL);
-            data.strAuthor = query.getStringField(documentDOCUMENT_AUTHOR);
-            data.strKeywords = query.getStringField(documentDOCUMENT_KEYWORDS);
-            data.strType = query.getStringField(documentDOCUMENT_TYPE);
-            data.strOwner = query.getStringField(documentDOCUMENT_OWNER);
-            data.strFileType = query.getStringField(documentDOCUMENT_FILE_TYPE);
-            data.strStyleGUID = query.getStringField(documentSTYLE_GUID);
-            data.tCreated = query.getTimeField(documentDT_CREATED);
-            data.tModified = query.getTimeField(documentDT_MODIFIED);
-            data.tAccessed = query.getTimeField(documentDT_ACCESSED);
-            data.nProtected = query.getIntField(documentDOCUMENT_PROTECT);
-            data.nReadCount = query.getIntField(documentDOCUMENT_READ_COUNT);
-            data.nAttachmentCount = query.getIntField(documentDOCUMENT_ATTACHEMENT_COUNT);
-            data.nIndexed = query.getIntField(documentDOCUMENT_INDEXED);
-            data.tDataModified = query.getTimeField(documentDT_DATA_MODIFIED);
-            data.strDataMD5 = query.getStringField(documentDOCUMENT_DATA_MD5);
-            data.nVersion = query.getInt64Field(documentVersion);
-            data.nInfoChanged = query.getIntField(documentINFO_CHANGED);
-            data.nDataChanged = query.getIntField(documentDATA_CHANGED);
-
-            arrayDocument.push_back(data);
-            query.nextRow();
-        }
+        WizIndexReader reader(*this);
+        CppSQLite3Query query = reader.db().execQuery(strSQL);
+        queryToDocumentDataArray(query, arrayDocument);
         return true;
     }
     catch (const CppSQLite3Exception& e)
@@ -486,12 +984,94 @@ bool WizIndexBase::sqlToDocumentDataArray(const CString& strSQL, CWizDocumentDat
     }
 }
 
+void WizIndexBase::queryToDocumentDataArray(CppSQLite3Query& query, CWizDocumentDataArray& arrayDocument)
+{
+    while (!query.eof())
+    {
+        WIZDOCUMENTDATA data;
+        queryToDocumentData(query, data);
+
+        arrayDocument.push_back(data);
+        query.nextRow();
+    }
+}
+
+void WizIndexBase::queryToDocumentData(CppSQLite3Query& query, WIZDOCUMENTDATA& data)
+{
+    data.strKbGUID = kbGUID();
+    data.strGUID = query.getStringField(documentDOCUMENT_GUID);
+    data.strTitle = query.getStringField(documentDOCUMENT_TITLE);
+    data.strLocation = query.getStringField(documentDOCUMENT_LOCATION);
+    data.strName = query.getStringField(documentDOCUMENT_NAME);
+    data.strSEO = query.getStringField(documentDOCUMENT_SEO);
+    data.strURL = query.getStringField(documentDOCUMENT_URL);
+    data.strAuthor = query.getStringField(documentDOCUMENT_AUTHOR);
+    data.strKeywords = query.getStringField(documentDOCUMENT_KEYWORDS);
+    data.strType = query.getStringField(documentDOCUMENT_TYPE);
+    data.strOwner = query.getStringField(documentDOCUMENT_OWNER);
+    data.strFileType = query.getStringField(documentDOCUMENT_FILE_TYPE);
+    data.strStyleGUID = query.getStringField(documentSTYLE_GUID);
+    data.tCreated = query.getTimeField(documentDT_CREATED);
+    data.tModified = query.getTimeField(documentDT_MODIFIED);
+    data.tAccessed = query.getTimeField(documentDT_ACCESSED);
+    data.nProtected = query.getIntField(documentDOCUMENT_PROTECT);
+    data.nReadCount = query.getIntField(documentDOCUMENT_READ_COUNT);
+    data.nAttachmentCount = query.getIntField(documentDOCUMENT_ATTACHEMENT_COUNT);
+    data.nIndexed = query.getIntField(documentDOCUMENT_INDEXED);
+    data.tDataModified = query.getTimeField(documentDT_DATA_MODIFIED);
+    data.strDataMD5 = query.getStringField(documentDOCUMENT_DATA_MD5);
+    data.nVersion = query.getInt64Field(documentVersion);
+    data.nInfoChanged = query.getIntField(documentINFO_CHANGED);
+    data.nDataChanged = query.getIntField(documentDATA_CHANGED);
+}
+
+int WizIndexBase::bindDocumentData(CppSQLite3CachedStatement& stmt, int nParam,
+                                   const WIZDOCUMENTDATA& data,
+                                   const WizOleDateTime& tInfoModified)
+{
+    stmt.bind(nParam++, data.strTitle);
+    stmt.bind(nParam++, data.strLocation);
+    stmt.bind(nParam++, data.strName);
+    stmt.bind(nParam++, data.strSEO);
+    stmt.bind(nParam++, data.strURL);
+    stmt.bind(nParam++, data.strAuthor);
+    stmt.bind(nParam++, data.strKeywords);
+    stmt.bind(nParam++, data.strType);
+    stmt.bind(nParam++, data.strOwner);
+    stmt.bind(nParam++, data.strFileType);
+    stmt.bind(nParam++, data.strStyleGUID);
+
+    stmt.bind(nParam++, data.tCreated);
+    stmt.bind(nParam++, data.tModified);
+    stmt.bind(nParam++, data.tAccessed);
+
+    stmt.bind(nParam++, 0);//data.nIconIndex
+    stmt.bind(nParam++, 0);//data.nSync
+    stmt.bind(nParam++, (int)data.nProtected);
+    stmt.bind(nParam++, (int)data.nReadCount);
+    stmt.bind(nParam++, (int)data.nAttachmentCount);
+    stmt.bind(nParam++, (int)data.nIndexed);
+
+    stmt.bind(nParam++, tInfoModified);//data.tInfoModified
+    stmt.bind(nParam++, data.strDataMD5);//data.strInfoMD5
+    stmt.bind(nParam++, data.tDataModified);
+    stmt.bind(nParam++, data.strDataMD5);
+    stmt.bind(nParam++, tInfoModified);//data.tParamModified
+    stmt.bind(nParam++, data.strDataMD5);//data.strParamMD5
+    stmt.bind(nParam++, (__int64)data.nVersion);
+    stmt.bind(nParam++, (int)data.nInfoChanged);
+    stmt.bind(nParam++, (int)data.nDataChanged);
+
+    return nParam;
+}
+
 bool WizIndexBase::sqlToDocumentAttachmentDataArray(const CString& strSQL,
                                                      CWizDocumentAttachmentDataArray& arrayAttachment)
 {
     try
     {
-        CppSQLite3Query query = m_db.execQuery(strSQL);
+        WizIndexReader reader(*this);
+        CppSQLite3Query query = reader.db().execQuery(strSQL);
         while (!query.eof())
         {
             WIZDOCUMENTATTACHMENTDATA data;
@@ -525,7 +1105,8 @@ bool WizIndexBase::sqlToMessageDataArray(const QString& strSQL,
 {
     try
     {
-        CppSQLite3Query query = m_db.execQuery(strSQL);
+        WizIndexReader reader(*this);
+        CppSQLite3Query query = reader.db().execQuery(strSQL);
         while (!query.eof())
         {
             WIZMESSAGEDATA data;
@@ -566,7 +1147,8 @@ bool WizIndexBase::sqlToBizUserDataArray(const QString& strSQL,
 {
     try
     {
-        CppSQLite3Query query = m_db.execQuery(strSQL);
+        WizIndexReader reader(*this);
+        CppSQLite3Query query = reader.db().execQuery(strSQL);
         while (!query.eof())
         {
             WIZBIZUSER data;
@@ -971,47 +1553,31 @@ bool WizIndexBase::createDocumentEx(const WIZDOCUMENTDATA& dataNew)
         TOLOG2("Document Location is empty: %1, Try to relocation to the %2", data.strTitle, data.strLocation);
     }
 
-    CString strFormat = formatInsertSQLFormat(TABLE_NAME_WIZ_DOCUMENT, FIELD_LIST_WIZ_DOCUMENT, PARAM_LIST_WIZ_DOCUMENT);
+    CString strSQL = formatStatementSQL(formatInsertSQLFormat(TABLE_NAME_WIZ_DOCUMENT, FIELD_LIST_WIZ_DOCUMENT, PARAM_LIST_WIZ_DOCUMENT));
 
-    CString strSQL;
-    strSQL.format(strFormat,
-        STR2SQL(data.strGUID).utf16(),
-        STR2SQL(data.strTitle).utf16(),
-        STR2SQL(data.strLocation).utf16(),
-        STR2SQL(data.strName).utf16(),
-        STR2SQL(data.strSEO).utf16(),
-        STR2SQL(data.strURL).utf16(),
-        STR2SQL(data.strAuthor).utf16(),
-        STR2SQL(data.strKeywords).utf16(),
-        STR2SQL(data.strType).utf16(),
-        STR2SQL(data.strOwner).utf16(),
-        STR2SQL(data.strFileType).utf16(),
-        STR2SQL(data.strStyleGUID).utf16(),
-
-        TIME2SQL(data.tCreated).utf16(),
-        TIME2SQL(data.tModified).utf16(),
-        TIME2SQL(data.tAccessed).utf16(),
+    {
+        WizDocumentCountWriter writer(*this);
 
-        0,//data.nIconIndex,
-        0,//data.nSync,
-        (int)data.nProtected,
-        (int)data.nReadCount,
-        (int)data.nAttachmentCount,
-        (int)data.nIndexed,
+        try
+        {
+            CppSQLite3CachedStatement stmt(m_db, strSQL);
+            stmt.bind(1, data.strGUID);
+            bindDocumentData(stmt, 2, data, data.tModified);
+            stmt.execDML();
+        }
+        catch (const CppSQLite3Exception& e)
+        {
+            return logSQLException(e, strSQL);
+        }
 
-        TIME2SQL(data.tModified).utf16(),//TIME2SQL(data.tInfoModified).utf16(),
-        STR2SQL(data.strDataMD5).utf16(),//STR2SQL(data.strInfoMD5).utf16(),
-        TIME2SQL(data.tDataModified).utf16(),
-        STR2SQL(data.strDataMD5).utf16(),
-        TIME2SQL(data.tModified).utf16(),//TIME2SQL(data.tParamModified).utf16(),
-        STR2SQL(data.strDataMD5).utf16(),//STR2SQL(data.strParamMD5).utf16(),
-        WizInt64ToStr(data.nVersion).utf16(),
-        (int)data.nInfoChanged,
-        (int)data.nDataChanged
-    );
+        updateDocumentFts(data);
 
-    if (!execSQL(strSQL))
-        return false;
+        updateLocationDocumentCount(data.strLocation, 1);
+        // tags may be written before document
+        if (!isTrashLocation(data.strLocation)) {
+            updateDocumentTagsCount(data.strGUID, 1);
+        }
+    }
 
     if (!m_bUpdating) {
         emit documentCreated(data);
@@ -1030,83 +1596,77 @@ bool WizIndexBase::modifyDocumentInfoEx(const WIZDOCUMENTDATA& dataCur)
     }
 
     WIZDOCUMENTDATA dataOld;
-    documentFromGuid(dataCur.strGUID, dataOld);
-
     WIZDOCUMENTDATA data = dataCur;
 
-    // try to fill the fields not allowed empty
-    if (data.strTitle.isEmpty()) {
-        if (!dataOld.strTitle.isEmpty()) {
-            data.strTitle = dataOld.strTitle;
-        } else {
-            data.strTitle = "New note";
-        }
+    {
+        // old location is read under the same lock as its count is changed
+        WizDocumentCountWriter writer(*this);
 
-        TOLOG2("Document Title is empty: %1, Try to rename to the %2", data.strGUID, data.strTitle);
-    }
+        documentFromGuid(dataCur.strGUID, dataOld);
 
-    if (data.strLocation.isEmpty()) {
-        if (!dataOld.strLocation.isEmpty()) {
-            data.strLocation = dataOld.strLocation;
-        } else {
-            data.strLocation = getDefaultNoteLocation();
+        // try to fill the fields not allowed empty
+        if (data.strTitle.isEmpty()) {
+            if (!dataOld.strTitle.isEmpty()) {
+                data.strTitle = dataOld.strTitle;
+            } else {
+                data.strTitle = "New note";
+            }
+
+            TOLOG2("Document Title is empty: %1, Try to rename to the %2", data.strGUID, data.strTitle);
         }
 
-        TOLOG2("Document Location is empty: %1, Try to relocation to the %2", data.strTitle, data.strLocation);
-    }
-    //
-    if (data.nVersion >= 0)
-    {
-        if (data.nDataChanged || data.nInfoChanged)
+        if (data.strLocation.isEmpty()) {
+            if (!dataOld.strLocation.isEmpty()) {
+                data.strLocation = dataOld.strLocation;
+            } else {
+                data.strLocation = getDefaultNoteLocation();
+            }
+
+            TOLOG2("Document Location is empty: %1, Try to relocation to the %2", data.strTitle, data.strLocation);
+        }
+        //
+        if (data.nVersion >= 0)
         {
-            qDebug() << "fault error: data changed or info changed is not false";
-            data.nDataChanged = 0;
-            data.nInfoChanged = 0;
+            if (data.nDataChanged || data.nInfoChanged)
+            {
+                qDebug() << "fault error: data changed or info changed is not false";
+                data.nDataChanged = 0;
+                data.nInfoChanged = 0;
+            }
         }
-    }
 
-    CString strFormat = formatUpdateSQLFormat(TABLE_NAME_WIZ_DOCUMENT, FIELD_LIST_WIZ_DOCUMENT_MODIFY, TABLE_KEY_WIZ_DOCUMENT);
-
-    CString strSQL;
-    strSQL.format(strFormat,
-        STR2SQL(data.strTitle).utf16(),
-        STR2SQL(data.strLocation).utf16(),
-        STR2SQL(data.strName).utf16(),
-        STR2SQL(data.strSEO).utf16(),
-        STR2SQL(data.strURL).utf16(),
-        STR2SQL(data.strAuthor).utf16(),
-        STR2SQL(data.strKeywords).utf16(),
-        STR2SQL(data.strType).utf16(),
-        STR2SQL(data.strOwner).utf16(),
-        STR2SQL(data.strFileType).utf16(),
-        STR2SQL(data.strStyleGUID).utf16(),
-
-        TIME2SQL(data.tCreated).utf16(),
-        TIME2SQL(data.tModified).utf16(),
-        TIME2SQL(data.tAccessed).utf16(),
+        CString strSQL = formatStatementSQL(formatUpdateSQLFormat(TABLE_NAME_WIZ_DOCUMENT, FIELD_LIST_WIZ_DOCUMENT_MODIFY, TABLE_KEY_WIZ_DOCUMENT));
 
-        0,//data.nIconIndex,
-        0,//data.nSync,
-        (int)data.nProtected,
-        (int)data.nReadCount,
-        (int)data.nAttachmentCount,
-        (int)data.nIndexed,
+        try
+        {
+            CppSQLite3CachedStatement stmt(m_db, strSQL);
+            int nParam = bindDocumentData(stmt, 1, data, data.tDataModified);
+            stmt.bind(nParam, data.strGUID);
+            stmt.execDML();
+        }
+        catch (const CppSQLite3Exception& e)
+        {
+            return logSQLException(e, strSQL);
+        }
 
-        TIME2SQL(data.tDataModified).utf16(),//TIME2SQL(data.tInfoModified).utf16(),
-        STR2SQL(data.strDataMD5 ).utf16(),//STR2SQL(data.strInfoMD5 ).utf16(),
-        TIME2SQL(data.tDataModified).utf16(),
-        STR2SQL(data.strDataMD5 ).utf16(),
-        TIME2SQL(data.tDataModified).utf16(),//TIME2SQL(data.tParamModified).utf16(),
-        STR2SQL(data.strDataMD5 ).utf16(),//STR2SQL(data.strParamMD5 ).utf16(),
-        WizInt64ToStr(data.nVersion).utf16(),
-        (int)data.nInfoChanged,
-        (int)data.nDataChanged,
+        if (data.strTitle != dataOld.strTitle
+                || data.strKeywords != dataOld.strKeywords
+                || data.strAuthor != dataOld.strAuthor
+                || data.strURL != dataOld.strURL) {
+            updateDocumentFts(data);
+        }
 
-        STR2SQL(data.strGUID).utf16()
-    );
+        if (!dataOld.strGUID.isEmpty() && data.strLocation != dataOld.strLocation) {
+            updateLocationDocumentCount(dataOld.strLocation, -1);
+            updateLocationDocumentCount(data.strLocation, 1);
 
-    if (!execSQL(strSQL))
-        return false;
+            bool bTrashOld = isTrashLocation(dataOld.strLocation);
+            bool bTrash = isTrashLocation(data.strLocation);
+            if (bTrashOld != bTrash) {
+                updateDocumentTagsCount(data.strGUID, bTrash ? -1 : 1);
+            }
+        }
+    }
 
     WIZDOCUMENTDATA dataNew;
     documentFromGuid(data.strGUID, dataNew);
@@ -1124,6 +1684,9 @@ bool WizIndexBase::deleteDocumentEx(const WIZDOCUMENTDATA& data)
 
     Q_ASSERT(data.strKbGUID == m_strKbGUID);
 
+    // fts row is found by rowid of document
+    deleteDocumentFts(data.strGUID);
+
     CString strFormat = formatDeleteSQLFormat(TABLE_NAME_WIZ_DOCUMENT, TABLE_KEY_WIZ_DOCUMENT);
 
     CString strSQL;
@@ -1131,8 +1694,23 @@ bool WizIndexBase::deleteDocumentEx(const WIZDOCUMENTDATA& data)
         STR2SQL(data.strGUID).utf16()
         );
 
-    if (!execSQL(strSQL))
-        return false;
+    {
+        WizDocumentCountWriter writer(*this);
+
+        // location of document in database, data may be incomplete
+        WIZDOCUMENTDATA dataOld;
+        bool bCounted = documentFromGuid(data.strGUID, dataOld);
+
+        if (!execSQL(strSQL))
+            return false;
+
+        if (bCounted) {
+            updateLocationDocumentCount(dataOld.strLocation, -1);
+            if (!isTrashLocation(dataOld.strLocation)) {
+                updateDocumentTagsCount(data.strGUID, -1);
+            }
+        }
+    }
 
     if (!m_bUpdating) {
         emit documentDeleted(data);
@@ -1420,11 +1998,7 @@ bool WizIndexBase::getAllDocumentsSize(int& count, bool bIncludeTrash /* = false
     if (bIncludeTrash) {
         strSQL = formatQuerySQL(TABLE_NAME_WIZ_DOCUMENT, "COUNT(*)");
     } else {
-        CString strWhere;
-        strWhere.format("DOCUMENT_LOCATION not like %s",
-                        STR2SQL(QString(LOCATION_DELETED_ITEMS) + "%").utf16());
-
-        strSQL = formatQuerySQL(TABLE_NAME_WIZ_DOCUMENT, "COUNT(*)", strWhere);
+        strSQL = formatQuerySQL(TABLE_NAME_WIZ_DOCUMENT, "COUNT(*)", "DOCUMENT_IN_TRASH=0");
     }
 
     return sqlToSize(strSQL, count);
@@ -1449,28 +2023,176 @@ bool WizIndexBase::documentFromGuid(const CString& strDocumentGUID, WIZDOCUMENTD
         return false;
     }
 
-    CString strWhere;
-    strWhere.format("DOCUMENT_GUID=%s",
-        STR2SQL(strDocumentGUID).utf16()
-        );
+    {
+        QMutexLocker locker(&m_mutexDocumentCache);
+        if (WizDocumentCacheItem* pItem = m_cacheDocument.object(strDocumentGUID)) {
+            data = pItem->data;
+            return true;
+        }
+    }
 
-    CString strSQL = formatQuerySQL(TABLE_NAME_WIZ_DOCUMENT, FIELD_LIST_WIZ_DOCUMENT, strWhere);
+    quint64 nGeneration = documentCacheGeneration();
+
+    CString strSQL = formatQuerySQL(TABLE_NAME_WIZ_DOCUMENT, FIELD_LIST_WIZ_DOCUMENT_CACHE, "DOCUMENT_GUID=?");
+
+    qint64 nRowId = 0;
+    try
+    {
+        CppSQLite3CachedStatement stmt(m_db, strSQL);
+        stmt.bind(1, strDocumentGUID);
+        CppSQLite3Query query = stmt.execQuery();
+        if (query.eof()) {
+            //TOLOG("Failed to get document by guid, result is empty");
+            return false;
+        }
 
-    CWizDocumentDataArray arrayDocument;
-    if (!sqlToDocumentDataArray(strSQL, arrayDocument)) {
+        queryToDocumentData(query, data);
+        nRowId = query.getInt64Field(documentROWID);
+    }
+    catch (const CppSQLite3Exception& e)
+    {
+        logSQLException(e, strSQL);
         TOLOG("Failed to get document by guid");
         return false;
     }
 
-    if (arrayDocument.empty()) {
-        //TOLOG("Failed to get document by guid, result is empty");
-        return false;
+    insertDocumentCache(data, nRowId, nGeneration);
+    return true;
+}
+
+bool WizIndexBase::documentsFromGuids(const CWizStdStringArray& arrayGUID, CWizDocumentDataArray& arrayDocument)
+{
+    QHash<QString, WIZDOCUMENTDATA> mapDocument;
+    CWizStdStringArray arrayMissing;
+    {
+        QMutexLocker locker(&m_mutexDocumentCache);
+        for (CWizStdStringArray::const_iterator it = arrayGUID.begin(); it != arrayGUID.end(); it++) {
+            if (WizDocumentCacheItem* pItem = m_cacheDocument.object(*it)) {
+                mapDocument.insert(*it, pItem->data);
+            } else {
+                arrayMissing.push_back(*it);
+            }
+        }
+    }
+
+    quint64 nGeneration = documentCacheGeneration();
+
+    CWizStdStringArray::const_iterator itBatch = arrayMissing.begin();
+    while (itBatch != arrayMissing.end())
+    {
+        CWizStdStringArray arrayBatch;
+        for (; itBatch != arrayMissing.end() && arrayBatch.size() < WIZ_INDEX_DOCUMENT_BATCH_MAX; itBatch++) {
+            arrayBatch.push_back(STR2SQL(*itBatch));
+        }
+
+        CString strText;
+        WizStringArrayToText(arrayBatch, strText, ",");
+
+        CString strWhere = WizFormatString1("DOCUMENT_GUID in (%1)", strText);
+        CString strSQL = formatQuerySQL(TABLE_NAME_WIZ_DOCUMENT, FIELD_LIST_WIZ_DOCUMENT_CACHE, strWhere);
+        try
+        {
+            CppSQLite3Query query = m_db.execQuery(strSQL);
+            while (!query.eof())
+            {
+                WIZDOCUMENTDATA data;
+                queryToDocumentData(query, data);
+                insertDocumentCache(data, query.getInt64Field(documentROWID), nGeneration);
+
+                mapDocument.insert(data.strGUID, data);
+                query.nextRow();
+            }
+        }
+        catch (const CppSQLite3Exception& e)
+        {
+            return logSQLException(e, strSQL);
+        }
+    }
+
+    for (CWizStdStringArray::const_iterator it = arrayGUID.begin(); it != arrayGUID.end(); it++) {
+        QHash<QString, WIZDOCUMENTDATA>::const_iterator itDocument = mapDocument.find(*it);
+        if (itDocument != mapDocument.end()) {
+            arrayDocument.push_back(itDocument.value());
+        }
     }
 
-    data = arrayDocument[0];
     return true;
 }
 
+quint64 WizIndexBase::documentCacheGeneration()
+{
+    QMutexLocker locker(&m_mutexDocumentCache);
+    return m_nDocumentCacheGeneration;
+}
+
+void WizIndexBase::insertDocumentCache(const WIZDOCUMENTDATA& data, qint64 nRowId, quint64 nGeneration)
+{
+    QMutexLocker locker(&m_mutexDocumentCache);
+
+    // a document is written after it was read, data may be out of date
+    if (nGeneration != m_nDocumentCacheGeneration)
+        return;
+
+    // rowids of evicted documents are left in map, drop them all sometimes
+    if (m_mapDocumentRowId.size() > WIZ_INDEX_DOCUMENT_CACHE_MAX * 2) {
+        m_cacheDocument.clear();
+        m_mapDocumentRowId.clear();
+    }
+
+    WizDocumentCacheItem* pItem = new WizDocumentCacheItem();
+    pItem->data = data;
+    pItem->nRowId = nRowId;
+    m_cacheDocument.insert(data.strGUID, pItem);
+    m_mapDocumentRowId.insert(nRowId, data.strGUID);
+}
+
+void WizIndexBase::clearDocumentCache()
+{
+    QMutexLocker locker(&m_mutexDocumentCache);
+    m_cacheDocument.clear();
+    m_mapDocumentRowId.clear();
+    m_nDocumentCacheGeneration++;
+    m_bDocumentCacheDirty = false;
+}
+
+void WizIndexBase::clearDocumentCacheIfDirty()
+{
+    QMutexLocker locker(&m_mutexDocumentCache);
+    if (!m_bDocumentCacheDirty)
+        return;
+
+    // documents read in transaction may be rolled back
+    m_cacheDocument.clear();
+    m_mapDocumentRowId.clear();
+    m_nDocumentCacheGeneration++;
+    m_bDocumentCacheDirty = false;
+}
+
+void WizIndexBase::documentUpdateHook(void* pArg, int nOperation, const char* lpszDatabase,
+                                      const char* lpszTable, sqlite3_int64 nRowId)
+{
+    Q_UNUSED(nOperation);
+    Q_UNUSED(lpszDatabase);
+
+    if (0 != strcmp(lpszTable, TABLE_NAME_WIZ_DOCUMENT))
+        return;
+
+    // called by writer while statement is executed, do not touch database here
+    WizIndexBase* pIndex = reinterpret_cast<WizIndexBase*>(pArg);
+    QMutexLocker locker(&pIndex->m_mutexDocumentCache);
+
+    pIndex->m_nDocumentCacheGeneration++;
+    if (pIndex->m_db.isTransactionOwner()) {
+        pIndex->m_bDocumentCacheDirty = true;
+    }
+
+    QHash<qint64, QString>::iterator it = pIndex->m_mapDocumentRowId.find(nRowId);
+    if (it != pIndex->m_mapDocumentRowId.end()) {
+        pIndex->m_cacheDocument.remove(it.value());
+        pIndex->m_mapDocumentRowId.erase(it);
+    }
+}
+
 bool WizIndexBase::getAttachments(CWizDocumentAttachmentDataArray& arrayAttachment)
 {
     CString strSQL = formatQuerySQL(TABLE_NAME_WIZ_DOCUMENT_ATTACHMENT, FIELD_LIST_WIZ_DOCUMENT_ATTACHMENT);
@@ -3,6 +3,10 @@
 
 #include <QObject>
 #include <QMetaType>
+#include <QMutex>
+#include <QCache>
+#include <QHash>
+#include <map>
 
 #include "WizQtHelper.h"
 #include "cppsqlite3.h"
@@ -28,6 +32,17 @@ public:
     CppSQLite3Query Query(const CString& strSQL);
     bool hasRecord(const CString& strSQL);
     bool getFirstRowFieldValue(const CString& strSQL, int nFieldIndex, CString& strValue);
+
+    // batch writes, see WizIndexTransaction
+    bool beginTransaction();
+    bool commitTransaction();
+    bool rollbackTransaction();
+    bool yieldTransaction();
+
+    // connection for queries, see WizIndexReader
+    CppSQLite3DB* acquireReadConnection();
+    void releaseReadConnection(CppSQLite3DB* db);
+
     bool repair(const QString& strDestFileName);
 
     QString kbGUID() const { return m_strKbGUID; }
@@ -67,9 +82,25 @@ public:
     bool getAllDocuments(CWizDocumentDataArray& arrayDocument);
     bool getDocumentsBySQLWhere(const CString& strSQLWhere, CWizDocumentDataArray& arrayDocument);
     bool documentFromGuid(const CString& strDocumentGUID, WIZDOCUMENTDATA& data);
+    // cached documents are not queried again, result is in order of arrayGUID
+    // and documents which do not exist are skipped
+    bool documentsFromGuids(const CWizStdStringArray& arrayGUID, CWizDocumentDataArray& arrayDocument);
 
     bool getAllDocumentsSize(int& count, bool bIncludeTrash = false);
 
+    // title, keywords, author and url are indexed by sqlite fts if available
+    bool isDocumentFtsEnabled() const { return m_bDocumentFts; }
+    // MATCH expression requires all keywords, NULL if nothing to match
+    static CString documentFtsMatch(const QString& strKeywords);
+    // latin keywords may be inside a word, fts only matches them as word prefix
+    static bool documentFtsHasLatin(const QString& strKeywords);
+
+    // document counts of category view, kept in memory and updated by
+    // every document and document tag change instead of group by queries
+    bool getLocationsDocumentCount(std::map<CString, int>& mapLocationDocumentCount);
+    bool getTagsDocumentCount(std::map<CString, int>& mapTagDocumentCount);    // not in trash
+    int getTrashDocumentCountFromCache();   // -1 if not loaded
+
     // attachments
     bool getAttachments(CWizDocumentAttachmentDataArray& arrayAttachment);
     bool attachmentFromGuid(const CString& strAttachcmentGUID, WIZDOCUMENTATTACHMENTDATA& data);
@@ -99,10 +130,98 @@ private:
     QString m_strFileName;
     QString m_strKbGUID;
     bool m_bUpdating;
+    bool m_bDocumentFts;
+
+    // read only connections, opened on demand if database is in wal mode
+    QList<CppSQLite3DB*> m_arrayReadConnection;
+    QList<CppSQLite3DB*> m_arrayFreeReadConnection;
+    QMutex m_mutexReadConnection;
+
+    void closeReadConnections();
+
+    QMutex m_mutexDocumentCount;
+    bool m_bDocumentCountLoaded;
+    std::map<CString, int> m_mapLocationDocumentCount;    // trash included
+    std::map<CString, int> m_mapTagDocumentCount;         // documents not in trash
+
+    bool loadDocumentCount();
+
+    // recently used documents by guid. any change of a WIZ_DOCUMENT row is
+    // reported by sqlite update hook and removes the document by its rowid.
+    struct WizDocumentCacheItem
+    {
+        WIZDOCUMENTDATA data;
+        qint64 nRowId;
+    };
+
+    QMutex m_mutexDocumentCache;
+    QCache<QString, WizDocumentCacheItem> m_cacheDocument;
+    QHash<qint64, QString> m_mapDocumentRowId;
+    quint64 m_nDocumentCacheGeneration;     // changed by every document write
+    bool m_bDocumentCacheDirty;             // documents written in transaction
+
+    quint64 documentCacheGeneration();
+    void insertDocumentCache(const WIZDOCUMENTDATA& data, qint64 nRowId, quint64 nGeneration);
+    void clearDocumentCache();
+    void clearDocumentCacheIfDirty();       // transaction ended
+    static void documentUpdateHook(void* pArg, int nOperation, const char* lpszDatabase,
+                                   const char* lpszTable, sqlite3_int64 nRowId);
+
+    // meta written in a transaction is notified when it's committed,
+    // so listeners never see a change which is rolled back
+    struct WizPendingMeta
+    {
+        Qt::HANDLE threadId;        // transaction owner
+        bool bDeleted;
+        QString strMetaName;
+        QString strKey;
+        QString strValue;
+    };
+
+    QMutex m_mutexPendingMeta;
+    QList<WizPendingMeta> m_listPendingMeta;
+
+    void endPendingMeta(bool bCommitted);   // transaction of current thread ended
 
 protected:
+    void notifyMetaModified(const QString& strMetaName, const QString& strKey, const QString& strValue);
+    void notifyMetaDeleted(const QString& strMetaName, const QString& strKey);
+
+    // a write of documents or tags and its count delta are done under this,
+    // so counts loaded by another thread have both or none of them.
+    // writer lock is taken first, same as by a write in a transaction
+    class WizDocumentCountWriter
+    {
+    public:
+        explicit WizDocumentCountWriter(WizIndexBase& index)
+            : m_writer(index.m_db)
+            , m_locker(&index.m_mutexDocumentCount)
+        {
+        }
+
+    private:
+        CppSQLite3WriterLocker m_writer;
+        QMutexLocker m_locker;
+    };
+
+    // no-op until counts are loaded
+    void resetDocumentCount();      // bulk changes, reloaded when used
+    void updateLocationDocumentCount(const QString& strLocation, int nDelta);
+    void updateTagDocumentCount(const QString& strTagGUID, int nDelta);
+    void updateDocumentTagsCount(const QString& strDocumentGUID, int nDelta);
+    void removeTagDocumentCount(const QString& strTagGUID);
+    // document exists and is not in trash
+    bool isDocumentCounted(const QString& strDocumentGUID);
+    static bool isTrashLocation(const QString& strLocation);
+
     bool logSQLException(const CppSQLite3Exception& e, const CString& strSQL);
 
+    bool checkIndex();
+    bool checkDocumentFts();
+    bool updateDocumentFts(const WIZDOCUMENTDATA& data);
+    bool deleteDocumentFts(const CString& strDocumentGUID);
+    static CString documentFtsText(const QString& strText);
+
     void beginUpdate() { m_bUpdating = true; }
     void endUpdate() { m_bUpdating = false; }
     bool isUpdating() const { return m_bUpdating; }
@@ -161,17 +280,24 @@ protected:
                                            const CString& strFieldList,
                                            int nCount);
 
+    // replace %s and %d of sql format with ? for CppSQLite3CachedStatement
+    static CString formatStatementSQL(const CString& strFormat);
+
     /* Basic operations */
     bool sqlToSize(const CString& strSQL, int& size);
 
     bool sqlToTagDataArray(const CString& strSQL,
                            CWizTagDataArray& arrayTag);
+    void queryToTagDataArray(CppSQLite3Query& query,
+                             CWizTagDataArray& arrayTag);
 
     bool sqlToStyleDataArray(const CString& strSQL,
                              CWizStyleDataArray& arrayStyle);
 
     bool sqlToMetaDataArray(const CString& strSQL,
                             CWizMetaDataArray& arrayMeta);
+    void queryToMetaDataArray(CppSQLite3Query& query,
+                              CWizMetaDataArray& arrayMeta);
 
     bool sqlToDeletedGuidDataArray(const CString& strSQL,
                                    CWizDeletedGUIDDataArray& arrayGUID);
@@ -181,6 +307,13 @@ protected:
 
     bool sqlToDocumentDataArray(const CString& strSQL,
                                 CWizDocumentDataArray& arrayDocument);
+    void queryToDocumentDataArray(CppSQLite3Query& query,
+                                  CWizDocumentDataArray& arrayDocument);
+    void queryToDocumentData(CppSQLite3Query& query, WIZDOCUMENTDATA& data);
+    // binds fields of FIELD_LIST_WIZ_DOCUMENT except DOCUMENT_GUID, from nParam
+    static int bindDocumentData(CppSQLite3CachedStatement& stmt, int nParam,
+                                const WIZDOCUMENTDATA& data,
+                                const WizOleDateTime& tInfoModified);
 
     bool sqlToDocumentAttachmentDataArray(const CString& strSQL,
                                           CWizDocumentAttachmentDataArray& arrayAttachment);
@@ -256,6 +389,81 @@ Q_SIGNALS:
     void userModified(const WIZBIZUSER& userOld,
                       const WIZBIZUSER& userNew);
     void userDeleted(const WIZBIZUSER& user);
+
+    // meta name and key are upper case, empty key: all keys of meta name
+    void metaModified(const QString& strMetaName, const QString& strKey,
+                      const QString& strValue);
+    void metaDeleted(const QString& strMetaName, const QString& strKey);
+};
+
+/*
+ * Write a batch of rows in one transaction instead of one fsync per row.
+ * Rolled back if commit() is not called before it goes out of scope.
+ * Call next() after each row, a long batch is committed in slices so
+ * writes of other threads don't wait for all of it.
+ */
+class WizIndexTransaction
+{
+public:
+    explicit WizIndexTransaction(WizIndexBase& index)
+        : m_index(index)
+    {
+        m_bActive = m_index.beginTransaction();
+    }
+
+    ~WizIndexTransaction()
+    {
+        if (m_bActive) {
+            m_index.rollbackTransaction();
+        }
+    }
+
+    bool commit()
+    {
+        if (!m_bActive)
+            return false;
+
+        m_bActive = false;
+        return m_index.commitTransaction();
+    }
+
+    void next()
+    {
+        if (m_bActive) {
+            m_index.yieldTransaction();
+        }
+    }
+
+private:
+    WizIndexBase& m_index;
+    bool m_bActive;
+};
+
+/*
+ * Connection for a query. In wal mode it is one of the read only
+ * connections, so list and search don't wait behind writes of sync.
+ * Queries in a transaction of current thread use the main connection
+ * to see their own changes.
+ */
+class WizIndexReader
+{
+public:
+    explicit WizIndexReader(WizIndexBase& index)
+        : m_index(index)
+        , m_db(index.acquireReadConnection())
+    {
+    }
+
+    ~WizIndexReader()
+    {
+        m_index.releaseReadConnection(m_db);
+    }
+
+    CppSQLite3DB& db() { return *m_db; }
+
+private:
+    WizIndexBase& m_index;
+    CppSQLite3DB* m_db;
 };
 
 
@@ -394,6 +602,14 @@ enum FieldIndex_WizDocument
         documentDATA_CHANGED
 };
 
+/* ---------------------------- WIZ_DOCUMENT_FTS ---------------------------- */
+// docid is rowid of WIZ_DOCUMENT, text is lower case and CJK characters are
+// separated by space, so simple tokenizer indexes them one by one.
+#define TABLE_NAME_WIZ_DOCUMENT_FTS "WIZ_DOCUMENT_FTS"
+
+#define FIELD_LIST_WIZ_DOCUMENT_FTS "\
+DOCUMENT_TITLE, DOCUMENT_KEYWORDS, DOCUMENT_AUTHOR, DOCUMENT_URL"
+
 /* ------------------------ WIZ_DOCUMENT_ATTACHMENT ------------------------ */
 #define TABLE_NAME_WIZ_DOCUMENT_ATTACHMENT  "WIZ_DOCUMENT_ATTACHMENT"
 
@@ -21,6 +21,11 @@
 #include <QNetworkAccessManager>
 #include <QNetworkRequest>
 #include <QNetworkReply>
+#if defined(Q_OS_WIN)
+#include <qt_windows.h>
+#else
+#include <stdio.h>
+#endif
 #include "utils/WizLogger.h"
 #include "utils/WizPathResolve.h"
 #include "utils/WizStyleHelper.h"
@@ -215,6 +220,17 @@ BOOL WizCopyFile(const CString& strSrcFileName, const CString& strDestFileName,
     //
     return fileSrc.copy(strDestFileName);
 }
+bool WizReplaceFile(const QString& strSrcFileName, const QString& strDestFileName)
+{
+#if defined(Q_OS_WIN)
+    return ::MoveFileExW((LPCWSTR)QDir::toNativeSeparators(strSrcFileName).utf16(),
+                         (LPCWSTR)QDir::toNativeSeparators(strDestFileName).utf16(),
+                         MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return 0 == ::rename(QFile::encodeName(strSrcFileName).constData(),
+                         QFile::encodeName(strDestFileName).constData());
+#endif
+}
 void WizGetNextFileName(CString& strFileName)
 {
     if (!WizPathFileExists(strFileName))
@@ -1118,6 +1134,14 @@ bool WizLoadUnicodeTextFromFile(const QString& strFileName, QString& strText)
     return true;
 }
 
+bool WizLoadUnicodeTextFromData(const QByteArray& data, QString& strText)
+{
+    QTextStream stream(data, QIODevice::ReadOnly | QIODevice::Text);
+    strText = stream.readAll();
+
+    return true;
+}
+
 bool WizLoadUtf8TextFromFile(const QString& strFileName, QString& strText)
 {
     QFile file(strFileName);
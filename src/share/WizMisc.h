@@ -98,6 +98,8 @@ void WizEnumFolders(const QString& strPath, CWizStdStringArray& arrayFolders, UI
 QString WizFolderNameByPath(const QString& strPath);
 
 BOOL WizCopyFile(const CString& strSrcFileName, const CString& strDestFileName, BOOL bFailIfExists);
+// atomic, existing dest file is kept if it fails. src and dest should be on the same volume
+bool WizReplaceFile(const QString& strSrcFileName, const QString& strDestFileName);
 bool WizCopyFolder(const QString& strSrcDir, const QString& strDestDir, bool bCoverFileIfExist);
 void WizGetNextFileName(CString& strFileName);
 
@@ -106,6 +108,7 @@ QString WizDecryptPassword(const QString& strEncryptedText);
 
 
 bool WizLoadUnicodeTextFromFile(const QString& strFileName, QString& strText);
+bool WizLoadUnicodeTextFromData(const QByteArray& data, QString& strText);
 bool WizLoadUtf8TextFromFile(const QString& strFileName, QString& strText);
 bool WizLoadTextFromResource(const QString& resourceName, QString& text);
 
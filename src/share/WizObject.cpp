@@ -158,6 +158,7 @@ bool WIZOBJECTPARTDATA::loadFromXmlRpc(WizXmlRpcStructValue& data)
 
 WIZOBJECTDATA::WIZOBJECTDATA()
     : eObjectType(wizobjectError)
+    , nVersion(-1)
 {
 
 }
@@ -169,6 +170,7 @@ WIZOBJECTDATA::WIZOBJECTDATA(const WIZOBJECTDATA& data)
     strKbGUID = data.strKbGUID;
     tTime = data.tTime;
     eObjectType = data.eObjectType;
+    nVersion = data.nVersion;
     arrayData = data.arrayData;
 }
 
@@ -179,6 +181,7 @@ WIZOBJECTDATA::WIZOBJECTDATA(const WIZDOCUMENTDATA& data)
     strKbGUID = data.strKbGUID;
     tTime = data.tDataModified;
     eObjectType = wizobjectDocument;
+    nVersion = data.nVersion;
 }
 
 WIZOBJECTDATA::WIZOBJECTDATA(const WIZDOCUMENTATTACHMENTDATA& data)
@@ -188,6 +191,7 @@ WIZOBJECTDATA::WIZOBJECTDATA(const WIZDOCUMENTATTACHMENTDATA& data)
     strKbGUID = data.strKbGUID;
     tTime = data.tDataModified;
     eObjectType = wizobjectDocumentAttachment;
+    nVersion = data.nVersion;
 }
 
 
@@ -455,6 +455,7 @@ struct WIZOBJECTDATA : public WIZOBJECTBASE
     CString strDisplayName;
     CString strObjectGUID;
     WizObjectType eObjectType;
+    qint64 nVersion;        // server version of object, -1 if unknown
 
     QByteArray arrayData;
 };
@@ -2,6 +2,7 @@
 
 #include <QDebug>
 #include <QEventLoop>
+#include <QFile>
 #include <QNetworkAccessManager>
 #include "utils/WizPathResolve.h"
 #include "share/WizThreads.h"
@@ -154,19 +155,24 @@ bool WizObjectDownloader::downloadNormalData()
     connect(&ksServer, SIGNAL(downloadProgress(int, int)), SLOT(on_downloadProgress(int,int)));
 
     // FIXME: should we query object before download data?
+    // not the file used by sync, the object may be downloading by sync too
+    QString strFileName = Utils::WizPathResolve::tempPath() + m_data.strObjectGUID + ".view.download";
+    QString strMD5;
     if (!ksServer.data_download(m_data.strObjectGUID,
                                 WIZOBJECTDATA::objectTypeToTypeString(m_data.eObjectType),
-                                m_data.arrayData, m_data.strDisplayName)) {
+                                strFileName, strMD5, m_data.strDisplayName)) {
+        QFile::remove(strFileName + ".part");
         return false;
     }
 
     if (WizDatabaseManager* dbMgr = WizDatabaseManager::instance())
     {
-        return dbMgr->db(m_data.strKbGUID).updateObjectData(m_data.strDisplayName, m_data.strObjectGUID,
-                                                             WIZOBJECTDATA::objectTypeToTypeString(m_data.eObjectType),
-                                                             m_data.arrayData);
+        return dbMgr->db(m_data.strKbGUID).updateObjectDataByFile(m_data.strDisplayName, m_data.strObjectGUID,
+                                                                   WIZOBJECTDATA::objectTypeToTypeString(m_data.eObjectType),
+                                                                   strFileName, strMD5);
     }
 
+    QFile::remove(strFileName);
     return false;
 }
 
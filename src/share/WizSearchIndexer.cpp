@@ -4,9 +4,11 @@
 #include <QMetaType>
 #include <QDebug>
 #include <QCoreApplication>
+#include <QSharedPointer>
 
 #ifndef Q_OS_WIN
 #include <unistd.h>
+#include <stdlib.h>
 #endif
 
 #include "WizDef.h"
@@ -14,26 +16,109 @@
 #include "WizSettings.h"
 #include "html/WizHtmlCollector.h"
 #include "WizDatabase.h"
+#include "WizGlobal.h"
+#include "WizThreads.h"
 #include "utils/WizLogger.h"
 #include "utils/WizPathResolve.h"
 
 #define TIMEINTERVAL  60 * 1000
+#define FTS_DIRTY_DELAY             3 * 1000
+// documents failed to index are picked again by a full scan, it's delayed
+// twice as long after every pass that still fails
+#define FTS_RETRY_DELAY             5 * 60 * 1000
+#define FTS_RETRY_MAX_DELAY         4 * 60 * 60 * 1000
+
+// batch indexing defaults, could be overridden in global settings [FTS]
+#define FTS_RAM_BUFFER_MB           32
+#define FTS_MERGE_FACTOR            20
+#define FTS_COMMIT_INTERVAL         500
+#define FTS_COMMIT_MAX_MSECS        30 * 1000
+#define FTS_CPU_USAGE               50
+#define FTS_IDLE_LOAD               0.75
+#define FTS_THROTTLE_MAX_MSECS      100
+#define FTS_QUEUE_PER_THREAD        4
+
+
+/* ------------------------- FTS text extraction queue ------------------------- */
+// extracted by worker threads, consumed by the single index writer thread
+struct WIZFTSTEXTDATA
+{
+    WIZDOCUMENTDATAEX doc;
+    QString strText;
+    bool bOk;
+
+    WIZFTSTEXTDATA() : bOk(false) {}
+};
+
+class WizFTSTextQueue
+{
+public:
+    void push(const WIZFTSTEXTDATA& data)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_queue.push_back(data);
+        m_wait.wakeOne();
+    }
+
+    bool pop(WIZFTSTEXTDATA& data, unsigned long nTimeout)
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_queue.empty()) {
+            m_wait.wait(&m_mutex, nTimeout);
+            if (m_queue.empty())
+                return false;
+        }
+
+        data = m_queue.front();
+        m_queue.pop_front();
+        return true;
+    }
+
+private:
+    QMutex m_mutex;
+    QWaitCondition m_wait;
+    std::deque<WIZFTSTEXTDATA> m_queue;
+};
+
 
 WizSearchIndexer::WizSearchIndexer(WizDatabaseManager& dbMgr, QObject *parent)
     : QThread(parent)
     , m_dbMgr(dbMgr)
     , m_stop(false)
+    , m_bFullScan(false)
+    , m_bDirty(false)
+    , m_pExtractPool(NULL)
+    , m_pWriter(NULL)
+    , m_nIndexed(0)
+    , m_nFailed(0)
+    , m_nRetryDelay(FTS_RETRY_DELAY)
 {
     qRegisterMetaType<WIZDOCUMENTDATAEX>("WIZDOCUMENTDATAEX");
 
     m_strIndexPath = m_dbMgr.db().getAccountPath() + "fts_index";
 
+    QSettings* settings = WizGlobal::globalSettings();
+    m_fRamBufferMB = settings->value("FTS/RamBufferMB", FTS_RAM_BUFFER_MB).toFloat();
+    m_nMergeFactor = settings->value("FTS/MergeFactor", FTS_MERGE_FACTOR).toInt();
+    m_nCommitInterval = qMax(1, settings->value("FTS/CommitInterval", FTS_COMMIT_INTERVAL).toInt());
+    m_nCpuUsage = qBound(1, settings->value("FTS/CpuUsage", FTS_CPU_USAGE).toInt(), 100);
+    m_nExtractThreads = qMax(1, settings->value("FTS/ExtractThreads", QThread::idealThreadCount()).toInt());
+
     // signals for deletion, database responsible for reset FTS flag when update document or attachment.
     connect(&m_dbMgr, SIGNAL(documentDeleted(const WIZDOCUMENTDATA&)), \
             SLOT(on_document_deleted(const WIZDOCUMENTDATA&)));
     connect(&m_dbMgr, SIGNAL(attachmentDeleted(const WIZDOCUMENTATTACHMENTDATA&)), \
             SLOT(on_attachment_deleted(const WIZDOCUMENTATTACHMENTDATA&)));
 
+    // saved or downloaded notes are indexed a few seconds later, without scanning databases
+    connect(&m_dbMgr, SIGNAL(documentCreated(const WIZDOCUMENTDATA&)), \
+            SLOT(on_document_dataModified(const WIZDOCUMENTDATA&)));
+    connect(&m_dbMgr, SIGNAL(documentDataModified(const WIZDOCUMENTDATA&)), \
+            SLOT(on_document_dataModified(const WIZDOCUMENTDATA&)));
+
+    m_timerDirty.setSingleShot(true);
+    connect(&m_timerDirty, SIGNAL(timeout()), SLOT(on_dirtyTimerOut()));
+
     m_timer.setSingleShot(true);
     connect(&m_timer, SIGNAL(timeout()), SLOT(on_timerOut()));
     connect(this, SIGNAL(startTimer(int)), &m_timer, SLOT(start(int)));
@@ -49,6 +134,15 @@ void WizSearchIndexer::rebuild() {
 void WizSearchIndexer::on_timerOut()
 {
     m_mutex.lock();
+    m_bFullScan = true;
+    m_wait.wakeAll();
+    m_mutex.unlock();
+}
+
+void WizSearchIndexer::on_dirtyTimerOut()
+{
+    m_mutex.lock();
+    m_bDirty = true;
     m_wait.wakeAll();
     m_mutex.unlock();
 }
@@ -57,6 +151,7 @@ void WizSearchIndexer::start(QThread::Priority priority)
 {
     QThread::start(priority);
 
+    // full scan once after startup, catch up notes changed while indexer was not running
     emit startTimer(TIMEINTERVAL);
 }
 
@@ -64,16 +159,46 @@ void WizSearchIndexer::run()
 {
     while (!m_stop)
     {
-        m_mutex.lock();
-        m_wait.wait(&m_mutex);
-        m_mutex.unlock();
+        bool bFullScan = false;
+        {
+            QMutexLocker locker(&m_mutex);
+            while (!m_stop && !m_bFullScan && !m_bDirty) {
+                m_wait.wait(&m_mutex);
+            }
 
-        if (m_stop)
-            return;
+            if (m_stop)
+                break;
+
+            bFullScan = m_bFullScan;
+            m_bFullScan = false;
+            m_bDirty = false;
+
+            // documents not indexed are all picked by full scan
+            if (bFullScan) {
+                m_mapDirty.clear();
+            }
+        }
         //
-        buildFTSIndex();
+        m_nFailed = 0;
+        bool bOk = bFullScan ? buildFTSIndex() : buildFTSIndexByDirtyDocuments();
+        if (m_stop)
+            break;
+
+        // failed documents are not flagged as indexed, but nothing else
+        // would pick them up again until next start
+        if (!bOk || m_nFailed > 0) {
+            TOLOG1("[FTS]notes failed to index will be retried in %1 minutes", WizIntToStr(m_nRetryDelay / 60000));
+            emit startTimer(m_nRetryDelay);
+            m_nRetryDelay = qMin(m_nRetryDelay * 2, FTS_RETRY_MAX_DELAY);
+        } else if (bFullScan) {
+            m_nRetryDelay = FTS_RETRY_DELAY;
+        }
+    }
 
-        emit startTimer(TIMEINTERVAL);
+    // extraction tasks still running are waited for
+    if (m_pExtractPool) {
+        m_pExtractPool->shutdown(0);
+        m_pExtractPool = NULL;
     }
 }
 
@@ -87,26 +212,45 @@ void WizSearchIndexer::waitForDone()
 bool WizSearchIndexer::buildFTSIndex()
 {
     int nErrors = 0;
+    m_nIndexed = 0;
+
+    // index created by old release use different document schema, documents
+    // of it can't be replaced one by one, drop whole index and rebuild.
+    if (m_dbMgr.db().getDocumentFTSVersion().toInt() < QString(WIZNOTE_FTS_VERSION).toInt()) {
+        qDebug() << "FTS index schema upgrade triggered...";
+        clearAllFTSData();
+    }
+
+    QTime counter;
+    counter.start();
 
     // build private first
     if (!buildFTSIndexByDatabase(m_dbMgr.db())) {
         nErrors++;
     }
 
-    if (m_stop)
-        return true;
-
     // build group db
     int total = m_dbMgr.count();
-    for (int i = 0; i < total; i++) {
-        if (m_stop)
-            return true;
-
+    for (int i = 0; i < total && !m_stop; i++) {
         if (!buildFTSIndexByDatabase(m_dbMgr.at(i))) {
             nErrors++;
         }
     }
 
+    // commit documents indexed so far even if stopped
+    if (!closeWriter()) {
+        nErrors++;
+    }
+
+    if (m_nIndexed > 0) {
+        double seconds = qMax(counter.elapsed(), 1) / 1000.0;
+        TOLOG(QString("FTS index updated: %1 notes in %2s, %3 docs/sec")
+              .arg(m_nIndexed).arg(seconds, 0, 'f', 1).arg(m_nIndexed / seconds, 0, 'f', 1));
+    }
+
+    if (m_stop)
+        return true;
+
     if (nErrors) {
         TOLOG(tr("Build FTS index meet error, we'll rebuild it when restart"));
         return false;
@@ -142,6 +286,51 @@ bool WizSearchIndexer::buildFTSIndexByDatabase(WizDatabase& db)
     if (!db.getAllDocumentsNeedToBeSearchIndexed(arrayDocuments))
         return false;
 
+    return indexDocuments(db, arrayDocuments);
+}
+
+bool WizSearchIndexer::buildFTSIndexByDirtyDocuments()
+{
+    QMap<QString, QString> mapDirty;
+    m_mutex.lock();
+    mapDirty.swap(m_mapDirty);
+    m_mutex.unlock();
+
+    // group documents by database
+    QMap<QString, CWizDocumentDataArray> mapDocuments;
+    QMap<QString, QString>::const_iterator it;
+    for (it = mapDirty.begin(); it != mapDirty.end(); it++) {
+        if (!m_dbMgr.isOpened(it.value()))
+            continue;
+
+        WIZDOCUMENTDATA doc;
+        if (!m_dbMgr.db(it.value()).documentFromGuid(it.key(), doc))
+            continue;
+
+        mapDocuments[it.value()].push_back(doc);
+    }
+
+    int nErrors = 0;
+    m_nIndexed = 0;
+
+    QMap<QString, CWizDocumentDataArray>::iterator itDb;
+    for (itDb = mapDocuments.begin(); itDb != mapDocuments.end() && !m_stop; itDb++) {
+        if (!indexDocuments(m_dbMgr.db(itDb.key()), itDb.value())) {
+            nErrors++;
+        }
+    }
+
+    if (!closeWriter()) {
+        nErrors++;
+    }
+
+    qDebug() << "[FTS]dirty documents indexed: " << m_nIndexed;
+
+    return nErrors == 0;
+}
+
+bool WizSearchIndexer::indexDocuments(WizDatabase& db, CWizDocumentDataArray& arrayDocuments)
+{
     // filter document data have not downloadeded or encrypted
     bool searchEncryptedDoc = false;
     if (!db.isGroup()) {
@@ -164,25 +353,76 @@ bool WizSearchIndexer::buildFTSIndexByDatabase(WizDatabase& db)
         return true;
     }
 
+    // worker threads unzip notes and convert them to plain text, this thread
+    // owns the index writer and consumes the extracted text. workers are
+    // kept for all passes, queue is shared with tasks which may outlive this
+    if (!m_pExtractPool) {
+        m_pExtractPool = WizCreateThreadPool(m_nExtractThreads, QThread::LowPriority);
+    }
+    IWizThreadPool* pool = m_pExtractPool;
+    QSharedPointer<WizFTSTextQueue> pQueue(new WizFTSTextQueue());
+    int nCapacity = m_nExtractThreads * FTS_QUEUE_PER_THREAD;
+
     int nErrors = 0;
     int nTotal = arrayDocuments.size();
-    for (int i = 0; i < nTotal; i++) {
+    int nSubmitted = 0;
+    int nDone = 0;
+    WizDatabase* pDb = &db;
+
+    QTime work;
+    work.start();
+
+    while (true) {
+        // keep documents in flight bounded so memory stays flat
+        while (!m_stop && nSubmitted < nTotal && nSubmitted - nDone < nCapacity) {
+            WIZDOCUMENTDATAEX doc = arrayDocuments.at(nSubmitted++);
+            pool->addTask(WizCreateRunable([=]() {
+                WIZFTSTEXTDATA data;
+                data.doc = doc;
+                data.bOk = extractDocumentText(*pDb, doc, data.strText);
+                pQueue->push(data);
+            }));
+        }
+
+        // all submitted documents are consumed
+        if (nDone == nSubmitted)
+            break;
+
         if (m_stop) {
-            return true;
+            // queued documents are dropped, running ones finish before
+            // the pool is shut down at the end of the thread
+            pool->clearTasks();
+            break;
         }
 
-        const WIZDOCUMENTDATAEX& doc = arrayDocuments.at(i);
+        WIZFTSTEXTDATA data;
+        if (!pQueue->pop(data, 500))
+            continue;
 
-        TOLOG(tr("Update search index (%1/%2): %3").arg(i + 1).arg(nTotal).arg(doc.strTitle));
-        if (!updateDocument(doc)) {
-            TOLOG(tr("[WARNING] failed to update: %1").arg(doc.strTitle));
+        nDone++;
+
+        TOLOG(tr("Update search index (%1/%2): %3").arg(nDone).arg(nTotal).arg(data.doc.strTitle));
+        if (!data.bOk || !updateDocument(data.doc, data.strText)) {
+            TOLOG(tr("[WARNING] failed to update: %1").arg(data.doc.strTitle));
             nErrors++;
+            m_nFailed++;
+        } else {
+            m_nIndexed++;
+        }
+
+        // commit periodically instead of optimizing the whole index for every note
+        if (m_arrayUncommitted.size() >= m_nCommitInterval
+                || m_timeLastCommit.elapsed() > FTS_COMMIT_MAX_MSECS) {
+            commitWriter();
         }
 
         // release CPU
-        msleep(100);
+        throttle(work.restart());
     }
 
+    if (m_stop)
+        return true;
+
     // clear usercipher after build fts
     if (searchEncryptedDoc) {
         clearDatabaseCipher(db);
@@ -228,69 +468,156 @@ void WizSearchIndexer::filterDocuments(WizDatabase& db, CWizDocumentDataArray& a
     }
 }
 
-bool WizSearchIndexer::updateDocument(const WIZDOCUMENTDATAEX& doc)
+bool WizSearchIndexer::updateDocument(const WIZDOCUMENTDATAEX& doc, const QString& strPlainText)
 {
     Q_ASSERT(!doc.strGUID.isEmpty());
 
-    void* pHandle = NULL;
-
-    if (!beginUpdateDocument(m_strIndexPath.toStdWString().c_str(), &pHandle)) {
+    void* pHandle = writerHandle();
+    if (!pHandle) {
         TOLOG("begin update failed while update FTS index");
         return false;
     }
 
-    bool ret = _updateDocumentImpl(pHandle, doc);
+    return _updateDocumentImpl(pHandle, doc, strPlainText);
+}
+
+void* WizSearchIndexer::writerHandle()
+{
+    QMutexLocker locker(&m_mutexWriter);
+    if (!m_pWriter) {
+        if (!beginUpdateDocument(m_strIndexPath.toStdWString().c_str(), &m_pWriter,
+                                 m_fRamBufferMB, m_nMergeFactor)) {
+            m_pWriter = NULL;
+            return NULL;
+        }
+        m_timeLastCommit.start();
+    }
+
+    return m_pWriter;
+}
+
+bool WizSearchIndexer::commitWriter()
+{
+    QMutexLocker locker(&m_mutexWriter);
+    if (!m_pWriter)
+        return true;
+
+    applyPendingDeletions();
+
+    bool ret = commitUpdateDocument(m_pWriter);
+    if (!ret) {
+        TOLOG("commit failed while update FTS index");
+    }
+
+    markCommittedDocuments(ret);
+    m_timeLastCommit.restart();
+    return ret;
+}
+
+bool WizSearchIndexer::closeWriter()
+{
+    QMutexLocker locker(&m_mutexWriter);
+    if (!m_pWriter)
+        return true;
+
+    applyPendingDeletions();
 
-    if (!endUpdateDocument(pHandle)) {
+    // merge policy keeps segments count bounded, a full optimize would rewrite whole index
+    bool ret = endUpdateDocument(m_pWriter, false);
+    if (!ret) {
         TOLOG("end update failed while update FTS index");
-        return false;
     }
 
+    m_pWriter = NULL;
+    markCommittedDocuments(ret);
     return ret;
 }
 
-bool WizSearchIndexer::_updateDocumentImpl(void *pHandle,
-                                            const WIZDOCUMENTDATAEX& doc)
+void WizSearchIndexer::applyPendingDeletions()
 {
-    WizDatabase& db = m_dbMgr.db(doc.strKbGUID);
+    // m_mutexWriter should be locked
+    foreach (const QString& strGUID, m_listPendingDeleted) {
+        WizCluceneSearch::deleteDocument(m_pWriter, strGUID.toStdWString().c_str());
+    }
+    m_listPendingDeleted.clear();
+}
 
-    // decompress
-    QString strTempFolder = Utils::WizPathResolve::tempPath() + doc.strGUID + "-update/";
-    if (!db.documentToHtmlFile(doc, strTempFolder)) {
-        TOLOG("Can't decompress document while update FTS index: " + doc.strTitle);
-        //Q_ASSERT(0);
-        return false;
+void WizSearchIndexer::markCommittedDocuments(bool bCommitted)
+{
+    // failed documents keep their flag and are indexed again by a retry pass
+    if (!bCommitted) {
+        m_nFailed += m_arrayUncommitted.size();
+    } else {
+        for (int i = 0; i < m_arrayUncommitted.size(); i++) {
+            const QString& strKbGUID = m_arrayUncommitted.at(i).first;
+            if (!m_dbMgr.isOpened(strKbGUID))
+                continue;
+
+            m_dbMgr.db(strKbGUID).setDocumentSearchIndexed(m_arrayUncommitted.at(i).second, true);
+        }
     }
-    QString strDataFile = strTempFolder + "index.html";
 
-    // get plain text content
+    m_arrayUncommitted.clear();
+}
+
+static double systemLoadPerCore()
+{
+#ifndef Q_OS_WIN
+    double load[1];
+    if (getloadavg(load, 1) == 1) {
+        return load[0] / qMax(QThread::idealThreadCount(), 1);
+    }
+#endif
+    // unknown, assume system is busy
+    return 1.0;
+}
+
+void WizSearchIndexer::throttle(int nWorkMilliseconds)
+{
+    // don't slow down indexing if nobody else needs CPU
+    if (systemLoadPerCore() < FTS_IDLE_LOAD)
+        return;
+
+    int nSleep = nWorkMilliseconds * (100 - m_nCpuUsage) / m_nCpuUsage;
+    msleep(qBound(1, nSleep, FTS_THROTTLE_MAX_MSECS));
+}
+
+bool WizSearchIndexer::extractDocumentText(WizDatabase& db, const WIZDOCUMENTDATAEX& doc,
+                                           QString& strPlainText)
+{
+    // read index.html from note archive directly, images are never decompressed
     QString strHtmlData;
-    if (!::WizLoadUnicodeTextFromFile(strDataFile, strHtmlData)) {
+    if (!db.loadDocumentHtml(doc, strHtmlData)) {
         TOLOG("Can't load document data while update FTS index:" + doc.strTitle);
         return false;
     }
 
-    QString strPlainText;
+    // get plain text content
     WizHtmlToPlainText htmlConverter;
     htmlConverter.toText(strHtmlData, strPlainText);
 
+    return true;
+}
+
+bool WizSearchIndexer::_updateDocumentImpl(void *pHandle,
+                                            const WIZDOCUMENTDATAEX& doc,
+                                            const QString& strPlainText)
+{
     bool ret = false;
     if (!strPlainText.isEmpty()) {
         ret = WizCluceneSearch::updateDocument(pHandle,
                                                 doc.strKbGUID.toStdWString().c_str(),
                                                 doc.strGUID.toStdWString().c_str(),
                                                 doc.strTitle.toLower().toStdWString().c_str(),
-                                                strPlainText.toLower().toStdWString().c_str());
+                                                strPlainText.toLower().toStdWString().c_str(),
+                                                doc.tDataModified.toTime_t());
     } else {
         ret = true;
     }
 
     if (ret) {
-        db.setDocumentSearchIndexed(doc.strGUID, true);
+        m_arrayUncommitted.append(qMakePair(doc.strKbGUID, doc.strGUID));
     }
-    //
-    ::WizDeleteAllFilesInFolder(strTempFolder);
-    ::WizDeleteFolder(strTempFolder);
 
     return ret;
 }
@@ -309,6 +636,7 @@ bool WizSearchIndexer::rebuildFTSIndex()
 {
     if (clearAllFTSData()) {
         m_mutex.lock();
+        m_bFullScan = true;
         m_wait.wakeAll();
         m_mutex.unlock();
         return true;
@@ -331,6 +659,7 @@ void WizSearchIndexer::clearFlags(WizDatabase& db)
 void WizSearchIndexer::stop()
 {
     emit stopTimer();
+    QMetaObject::invokeMethod(&m_timerDirty, "stop");
 
     m_mutex.lock();
     m_stop = true;
@@ -340,6 +669,8 @@ void WizSearchIndexer::stop()
 
 bool WizSearchIndexer::clearAllFTSData()
 {
+    closeSearcher();
+
     if (!::WizDeleteAllFilesInFolder(m_strIndexPath)) {
         TOLOG("Can't delete old index files while rebuild FTS index");
         return false;
@@ -355,8 +686,29 @@ bool WizSearchIndexer::clearAllFTSData()
     return true;
 }
 
+void WizSearchIndexer::on_document_dataModified(const WIZDOCUMENTDATA& doc)
+{
+    m_mutex.lock();
+    m_mapDirty[doc.strGUID] = doc.strKbGUID;
+    m_mutex.unlock();
+
+    // restart, editor may save the same note several times in a row
+    m_timerDirty.start(FTS_DIRTY_DELAY);
+}
+
 void WizSearchIndexer::on_document_deleted(const WIZDOCUMENTDATA& doc)
 {
+    m_mutex.lock();
+    m_mapDirty.remove(doc.strGUID);
+    m_mutex.unlock();
+
+    QMutexLocker locker(&m_mutexWriter);
+    if (m_pWriter) {
+        // index is locked by the writer of current pass, delete it with next commit
+        m_listPendingDeleted.append(doc.strGUID);
+        return;
+    }
+
     deleteDocument(doc);
 }
 
@@ -367,6 +719,8 @@ void WizSearchIndexer::on_attachment_deleted(const WIZDOCUMENTATTACHMENTDATA& at
 
 
 #define SEARCH_PAGE_MAX 100
+#define SEARCH_SNIPPET_CONTEXT 40   // characters before first keyword
+#define SEARCH_SNIPPET_LENGTH 160
 
 
 /* ----------------------------- CWizSearcher ----------------------------- */
@@ -393,7 +747,7 @@ void WizSearcher::search(const QString &strKeywords, int nMaxSize /* = -1 */, Se
 
 void WizSearcher::searchByDateCreate(SearchDateInterval dateInterval, int nMaxSize, SearchScope scope)
 {
-    m_mapDocumentSearched.clear();
+    clearSearchedDocuments();
     m_nMaxResult = nMaxSize;
     m_scope = scope;
     WizOleDateTime dt = getDateByInterval(dateInterval);
@@ -407,7 +761,7 @@ void WizSearcher::searchByDateCreate(SearchDateInterval dateInterval, int nMaxSi
         for (it = arrayDocument.begin(); it != arrayDocument.end(); it++) {
 
             const WIZDOCUMENTDATAEX& doc = *it;
-            m_mapDocumentSearched[doc.strGUID] = doc;
+            addSearchedDocument(doc);
             m_nResults++;
             if (m_nResults > nMaxSize)
                 break;
@@ -423,7 +777,7 @@ void WizSearcher::searchByDateCreate(SearchDateInterval dateInterval, int nMaxSi
 
             for (it = arrayDocument.begin(); it != arrayDocument.end(); it++) {
                 const WIZDOCUMENTDATAEX& doc = *it;
-                m_mapDocumentSearched[doc.strGUID] = doc;
+                addSearchedDocument(doc);
                 m_nResults++;
                 if (m_nResults > nMaxSize)
                     break;
@@ -433,14 +787,14 @@ void WizSearcher::searchByDateCreate(SearchDateInterval dateInterval, int nMaxSi
         }
     }
 
-    qDebug() << QString("[Search]Find %1 results in database").arg(m_mapDocumentSearched.size());
+    qDebug() << QString("[Search]Find %1 results in database").arg(m_arrayDocumentSearched.size());
 
     emitSearchProcess("");
 }
 
 void WizSearcher::searchByDateModified(SearchDateInterval dateInterval, int nMaxSize, SearchScope scope)
 {
-    m_mapDocumentSearched.clear();
+    clearSearchedDocuments();
     m_nMaxResult = nMaxSize;
     m_scope = scope;
     WizOleDateTime dt = getDateByInterval(dateInterval);
@@ -454,7 +808,7 @@ void WizSearcher::searchByDateModified(SearchDateInterval dateInterval, int nMax
         for (it = arrayDocument.begin(); it != arrayDocument.end(); it++) {
 
             const WIZDOCUMENTDATAEX& doc = *it;
-            m_mapDocumentSearched[doc.strGUID] = doc;
+            addSearchedDocument(doc);
             m_nResults++;
             if (m_nResults > nMaxSize)
                 break;
@@ -470,7 +824,7 @@ void WizSearcher::searchByDateModified(SearchDateInterval dateInterval, int nMax
 
             for (it = arrayDocument.begin(); it != arrayDocument.end(); it++) {
                 const WIZDOCUMENTDATAEX& doc = *it;
-                m_mapDocumentSearched[doc.strGUID] = doc;
+                addSearchedDocument(doc);
                 m_nResults++;
                 if (m_nResults > nMaxSize)
                     break;
@@ -480,14 +834,14 @@ void WizSearcher::searchByDateModified(SearchDateInterval dateInterval, int nMax
         }
     }
 
-    qDebug() << QString("[Search]Find %1 results in database").arg(m_mapDocumentSearched.size());
+    qDebug() << QString("[Search]Find %1 results in database").arg(m_arrayDocumentSearched.size());
 
     emitSearchProcess("");
 }
 
 void WizSearcher::searchByDateAccessed(SearchDateInterval dateInterval, int nMaxSize, SearchScope scope)
 {
-    m_mapDocumentSearched.clear();
+    clearSearchedDocuments();
     m_nMaxResult = nMaxSize;
     m_scope = scope;
     WizOleDateTime dt = getDateByInterval(dateInterval);
@@ -501,7 +855,7 @@ void WizSearcher::searchByDateAccessed(SearchDateInterval dateInterval, int nMax
         for (it = arrayDocument.begin(); it != arrayDocument.end(); it++) {
 
             const WIZDOCUMENTDATAEX& doc = *it;
-            m_mapDocumentSearched[doc.strGUID] = doc;
+            addSearchedDocument(doc);
             m_nResults++;
             if (m_nResults > nMaxSize)
                 break;
@@ -517,7 +871,7 @@ void WizSearcher::searchByDateAccessed(SearchDateInterval dateInterval, int nMax
 
             for (it = arrayDocument.begin(); it != arrayDocument.end(); it++) {
                 const WIZDOCUMENTDATAEX& doc = *it;
-                m_mapDocumentSearched[doc.strGUID] = doc;
+                addSearchedDocument(doc);
                 m_nResults++;
                 if (m_nResults > nMaxSize)
                     break;
@@ -527,7 +881,7 @@ void WizSearcher::searchByDateAccessed(SearchDateInterval dateInterval, int nMax
         }
     }
 
-    qDebug() << QString("[Search]Find %1 results in database").arg(m_mapDocumentSearched.size());
+    qDebug() << QString("[Search]Find %1 results in database").arg(m_arrayDocumentSearched.size());
 
     emitSearchProcess("");
 }
@@ -543,11 +897,13 @@ void WizSearcher::waitForDone()
     stop();
 
     WizWaitForThread(this);
+
+    closeSearcher();
 }
 
 void WizSearcher::doSearch()
 {
-    m_mapDocumentSearched.clear();
+    clearSearchedDocuments();
     m_nResults = 0;
 
     if (!QMetaObject::invokeMethod(this, "searchKeyword",
@@ -569,9 +925,7 @@ void WizSearcher::searchKeyword(const QString& strKeywords)
 
     if (m_nResults < m_nMaxResult)
     {
-        // NOTE: make sure convert keyword to lower case
-        searchDocument(m_strIndexPath.toStdWString().c_str(),
-                       strKeywords.toLower().toStdWString().c_str());
+        searchIndexByKeyword(strKeywords);
     }
 
     int nMilliseconds = counter.elapsed();
@@ -580,6 +934,167 @@ void WizSearcher::searchKeyword(const QString& strKeywords)
     emitSearchProcess(strKeywords);
 }
 
+std::wstring WizSearcher::scopeKbGUID(SearchScope scope)
+{
+    if (Scope_AllNotes == scope)
+        return std::wstring();
+
+    // personal: only personal kb, group: all but personal kb
+    return m_dbMgr.db().kbGUID().toStdWString();
+}
+
+// load hit documents of each kb with batched queries instead of one query
+// per hit. documents of closed databases or deleted ones are not in map
+static void WizSearchPrefetchDocuments(WizDatabaseManager& dbMgr, const std::vector<WIZFTSHIT>& arrayHit,
+                                       QHash<QString, WIZDOCUMENTDATAEX>& mapDocument)
+{
+    QMap<QString, CWizStdStringArray> mapGUID;
+    std::vector<WIZFTSHIT>::const_iterator it;
+    for (it = arrayHit.begin(); it != arrayHit.end(); it++) {
+        mapGUID[QString::fromStdString(it->strKbGUID)].push_back(QString::fromStdString(it->strDocumentID));
+    }
+
+    QMap<QString, CWizStdStringArray>::const_iterator itKb;
+    for (itKb = mapGUID.begin(); itKb != mapGUID.end(); itKb++) {
+        if (!dbMgr.isOpened(itKb.key()))
+            continue;
+
+        CWizDocumentDataArray arrayDocument;
+        dbMgr.db(itKb.key()).documentsFromGuids(itKb.value(), arrayDocument);
+
+        CWizDocumentDataArray::const_iterator itDocument;
+        for (itDocument = arrayDocument.begin(); itDocument != arrayDocument.end(); itDocument++) {
+            mapDocument.insert(itDocument->strGUID, *itDocument);
+        }
+    }
+}
+
+bool WizSearcher::searchIndexByKeyword(const QString& strKeywords)
+{
+    // NOTE: make sure convert keyword to lower case
+    std::wstring strIndexPath = m_strIndexPath.toStdWString();
+    std::wstring strKeywordsLower = strKeywords.toLower().toStdWString();
+
+    if (m_nMaxResult <= 0) {
+        return searchDocument(strIndexPath.c_str(), strKeywordsLower.c_str());
+    }
+
+    // limited results, only best ones are loaded from index, in score order
+    CWizSearchResultArray arrayResult;
+    if (!searchRanked(strKeywords, m_nMaxResult, false, arrayResult, m_scope))
+        return false;
+
+    CWizSearchResultArray::const_iterator it;
+    for (it = arrayResult.begin(); it != arrayResult.end(); it++) {
+        if (m_nResults >= m_nMaxResult)
+            break;
+
+        if (m_setDocumentSearched.contains(it->doc.strGUID))
+            continue;
+
+        m_nResults++;
+        addSearchedDocument(it->doc);
+    }
+
+    onSearchEnd();
+    return true;
+}
+
+static QString WizSearchMakeSnippet(const QString& strText, const QStringList& listKey)
+{
+    // first keyword in text
+    int nFirst = -1;
+    foreach (const QString& strKey, listKey) {
+        int nPos = strText.indexOf(strKey, 0, Qt::CaseInsensitive);
+        if (nPos >= 0 && (nFirst < 0 || nPos < nFirst)) {
+            nFirst = nPos;
+        }
+    }
+
+    int nStart = nFirst > SEARCH_SNIPPET_CONTEXT ? nFirst - SEARCH_SNIPPET_CONTEXT : 0;
+    QString strPart = strText.mid(nStart, SEARCH_SNIPPET_LENGTH);
+
+    // highlight every keyword in snippet
+    QString strSnippet;
+    int nPos = 0;
+    while (nPos < strPart.length()) {
+        int nMatch = -1;
+        int nMatchLength = 0;
+        foreach (const QString& strKey, listKey) {
+            int n = strPart.indexOf(strKey, nPos, Qt::CaseInsensitive);
+            if (n >= 0 && (nMatch < 0 || n < nMatch || (n == nMatch && strKey.length() > nMatchLength))) {
+                nMatch = n;
+                nMatchLength = strKey.length();
+            }
+        }
+
+        if (nMatch < 0) {
+            strSnippet += strPart.mid(nPos).toHtmlEscaped();
+            break;
+        }
+
+        strSnippet += strPart.mid(nPos, nMatch - nPos).toHtmlEscaped();
+        strSnippet += "<b>" + strPart.mid(nMatch, nMatchLength).toHtmlEscaped() + "</b>";
+        nPos = nMatch + nMatchLength;
+    }
+
+    if (nStart > 0)
+        strSnippet.prepend("...");
+    if (nStart + strPart.length() < strText.length())
+        strSnippet.append("...");
+
+    return strSnippet;
+}
+
+bool WizSearcher::searchRanked(const QString& strKeywords, int nTopK, bool bSnippet,
+                               CWizSearchResultArray& arrayResult, SearchScope scope)
+{
+    arrayResult.clear();
+
+    QString strKeywordsLower = strKeywords.toLower();
+    std::wstring strKbGUID = scopeKbGUID(scope);
+    std::vector<WIZFTSHIT> arrayHit;
+    if (!searchTopDocuments(m_strIndexPath.toStdWString().c_str(),
+                            strKeywordsLower.toStdWString().c_str(),
+                            nTopK, arrayHit, strKbGUID.c_str(), Scope_GroupNotes == scope)) {
+        return false;
+    }
+
+    QStringList listKey = strKeywordsLower.split(getWizSearchSplitChar(), QString::SkipEmptyParts);
+
+    QHash<QString, WIZDOCUMENTDATAEX> mapDocument;
+    WizSearchPrefetchDocuments(m_dbMgr, arrayHit, mapDocument);
+
+    std::vector<WIZFTSHIT>::const_iterator it;
+    for (it = arrayHit.begin(); it != arrayHit.end(); it++) {
+        QHash<QString, WIZDOCUMENTDATAEX>::const_iterator itDocument = mapDocument.constFind(QString::fromStdString(it->strDocumentID));
+        if (itDocument == mapDocument.constEnd())
+            continue;
+
+        const WIZDOCUMENTDATAEX& doc = itDocument.value();
+        QString strKbGUID = QString::fromStdString(it->strKbGUID);
+        if (!m_dbMgr.isOpened(strKbGUID))
+            continue;
+
+        WizDatabase& db = m_dbMgr.db(strKbGUID);
+
+        WIZSEARCHRESULT result;
+        result.doc = doc;
+        result.fScore = it->fScore;
+
+        // text is loaded for returned notes only
+        QString strText;
+        if (bSnippet && !doc.nProtected
+                && WizSearchIndexer::extractDocumentText(db, result.doc, strText)) {
+            result.strSnippet = WizSearchMakeSnippet(strText, listKey);
+        }
+
+        arrayResult.push_back(result);
+    }
+
+    return true;
+}
+
 void WizSearcher::searchDatabaseByKeyword(const QString& strKeywords)
 {
     CWizDocumentDataArray arrayDocument;
@@ -592,7 +1107,7 @@ void WizSearcher::searchDatabaseByKeyword(const QString& strKeywords)
         for (it = arrayDocument.begin(); it != arrayDocument.end(); it++) {
 
             const WIZDOCUMENTDATAEX& doc = *it;
-            m_mapDocumentSearched[doc.strGUID] = doc;
+            addSearchedDocument(doc);
             m_nResults++;
         }
 
@@ -606,7 +1121,7 @@ void WizSearcher::searchDatabaseByKeyword(const QString& strKeywords)
 
             for (it = arrayDocument.begin(); it != arrayDocument.end(); it++) {
                 const WIZDOCUMENTDATAEX& doc = *it;
-                m_mapDocumentSearched[doc.strGUID] = doc;
+                addSearchedDocument(doc);
                 m_nResults++;
             }
 
@@ -614,12 +1129,12 @@ void WizSearcher::searchDatabaseByKeyword(const QString& strKeywords)
         }
     }
 
-    qDebug() << QString("[Search]Find %1 results in database").arg(m_mapDocumentSearched.size());
+    qDebug() << QString("[Search]Find %1 results in database").arg(m_arrayDocumentSearched.size());
 }
 
 void WizSearcher::searchBySQLWhere(const QString& strWhere, int nMaxSize, SearchScope scope)
 {
-    m_mapDocumentSearched.clear();
+    clearSearchedDocuments();
     m_nMaxResult = nMaxSize;
     m_scope = scope;
     //
@@ -632,7 +1147,7 @@ void WizSearcher::searchBySQLWhere(const QString& strWhere, int nMaxSize, Search
         for (it = arrayDocument.begin(); it != arrayDocument.end(); it++) {
 
             const WIZDOCUMENTDATAEX& doc = *it;
-            m_mapDocumentSearched[doc.strGUID] = doc;
+            addSearchedDocument(doc);
             m_nResults++;
         }
 
@@ -646,14 +1161,14 @@ void WizSearcher::searchBySQLWhere(const QString& strWhere, int nMaxSize, Search
 
             for (it = arrayDocument.begin(); it != arrayDocument.end(); it++) {
                 const WIZDOCUMENTDATAEX& doc = *it;
-                m_mapDocumentSearched[doc.strGUID] = doc;
+                addSearchedDocument(doc);
                 m_nResults++;
             }
 
             arrayDocument.clear();
         }
     }
-    qDebug() << QString("[Search]Find %1 results in database").arg(m_mapDocumentSearched.size());
+    qDebug() << QString("[Search]Find %1 results in database").arg(m_arrayDocumentSearched.size());
 
     emitSearchProcess("");
 }
@@ -668,14 +1183,12 @@ void WizSearcher::searchByKeywordAndWhere(const QString& strKeywords,
     m_nMaxResult = nMaxSize;
     m_scope = scope;
     m_nResults = 0;
-    m_mapDocumentSearched.clear();
+    clearSearchedDocuments();
     searchDatabaseByKeyword(strKeywords);
 
     if (m_nResults < m_nMaxResult)
     {
-        // NOTE: make sure convert keyword to lower case
-        searchDocument(m_strIndexPath.toStdWString().c_str(),
-                       strKeywords.toLower().toStdWString().c_str());
+        searchIndexByKeyword(strKeywords);
     }
 
     // search by where
@@ -704,20 +1217,17 @@ void WizSearcher::searchByKeywordAndWhere(const QString& strKeywords,
         arrayDocument.clear();
     }
 
-    QSet<QString> keywordSet = m_mapDocumentSearched.keys().toSet();
-
-    keywordSet.intersect(whereSet);
-
-    QMap<QString, WIZDOCUMENTDATAEX> keywordSearchMap = m_mapDocumentSearched;
-    m_mapDocumentSearched.clear();
-    QMap<QString, WIZDOCUMENTDATAEX>::iterator itM;
-    for (itM = keywordSearchMap.begin(); itM != keywordSearchMap.end(); itM++)
+    // keep order of keyword results
+    CWizDocumentDataArray arrayKeyword;
+    arrayKeyword.swap(m_arrayDocumentSearched);
+    clearSearchedDocuments();
+    for (it = arrayKeyword.begin(); it != arrayKeyword.end(); it++)
     {
-        if (keywordSet.contains(itM.key()))
-            m_mapDocumentSearched.insert(itM.key(), itM.value());
+        if (whereSet.contains(it->strGUID))
+            addSearchedDocument(*it);
     }
 
-    qDebug() << QString("[Search]Find %1 results in database").arg(m_mapDocumentSearched.size());
+    qDebug() << QString("[Search]Find %1 results in database").arg(m_arrayDocumentSearched.size());
 
 
     emitSearchProcess(strKeywords);
@@ -750,16 +1260,16 @@ WizOleDateTime WizSearcher::getDateByInterval(SearchDateInterval dateInterval)
 
 void WizSearcher::emitSearchProcess(const QString& strKeywords)
 {
-    int nTimes = m_mapDocumentSearched.size() % SEARCH_PAGE_MAX ?
-                (m_mapDocumentSearched.size() / SEARCH_PAGE_MAX) + 1: (m_mapDocumentSearched.size() / SEARCH_PAGE_MAX);
+    int nTimes = m_arrayDocumentSearched.size() % SEARCH_PAGE_MAX ?
+                (m_arrayDocumentSearched.size() / SEARCH_PAGE_MAX) + 1: (m_arrayDocumentSearched.size() / SEARCH_PAGE_MAX);
     int nPos = 0;
     for (int i = 0; i < nTimes; i++) {
 
         CWizDocumentDataArray arrayDocument;
-        QMap<QString, WIZDOCUMENTDATAEX>::const_iterator it;
+        CWizDocumentDataArray::const_iterator it;
         int nCounter = 0;
-        for (it = m_mapDocumentSearched.begin() + nPos; it != m_mapDocumentSearched.end() && nCounter < SEARCH_PAGE_MAX; it++, nCounter ++) {
-            arrayDocument.push_back(it.value());
+        for (it = m_arrayDocumentSearched.begin() + nPos; it != m_arrayDocumentSearched.end() && nCounter < SEARCH_PAGE_MAX; it++, nCounter ++) {
+            arrayDocument.push_back(*it);
             nPos++;
         }
 
@@ -796,7 +1306,7 @@ bool WizSearcher::onSearchProcess(const std::string& lpszKbGUID,
     QString strGUID = QString::fromStdString(lpszDocumentID);
 
     // not searched before
-    if (m_mapDocumentSearched.contains(strGUID)) {
+    if (m_setDocumentSearched.contains(strGUID)) {
         return true;
     }
 
@@ -821,11 +1331,26 @@ bool WizSearcher::onSearchProcess(const std::string& lpszKbGUID,
     }
 
     m_nResults++;
-    m_mapDocumentSearched[strGUID] = doc;
+    addSearchedDocument(doc);
 
     return true;
 }
 
+void WizSearcher::addSearchedDocument(const WIZDOCUMENTDATAEX& doc)
+{
+    if (m_setDocumentSearched.contains(doc.strGUID))
+        return;
+
+    m_setDocumentSearched.insert(doc.strGUID);
+    m_arrayDocumentSearched.push_back(doc);
+}
+
+void WizSearcher::clearSearchedDocuments()
+{
+    m_arrayDocumentSearched.clear();
+    m_setDocumentSearched.clear();
+}
+
 bool WizSearcher::onSearchEnd()
 {
     qDebug() << "[Search]Search process end, total: " << m_nResults;
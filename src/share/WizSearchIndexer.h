@@ -2,7 +2,11 @@
 #define WIZSEARCHINDEXER_H
 
 #include <QTimer>
+#include <QTime>
 #include <QMap>
+#include <QSet>
+#include <QPair>
+#include <QStringList>
 #include <QThread>
 #include  <deque>
 #include <QWaitCondition>
@@ -13,6 +17,7 @@
 
 struct WIZDOCUMENTDATAEX;
 typedef std::deque<WIZDOCUMENTDATAEX> CWizDocumentDataArray;
+struct IWizThreadPool;
 
 
 enum SearchDateInterval {
@@ -42,12 +47,17 @@ public:
     void waitForDone();
     void rebuild();
 
+    // thread safe, called by text extraction workers and search snippets
+    static bool extractDocumentText(WizDatabase& db, const WIZDOCUMENTDATAEX& doc,
+                                    QString& strPlainText);
+
 signals:
     void startTimer(int interval);
     void stopTimer();
 
 public slots:
     void on_timerOut();
+    void on_dirtyTimerOut();
     void start(Priority priority = InheritPriority);
 
 protected:
@@ -56,12 +66,22 @@ protected:
 private:
     bool buildFTSIndex();
     bool buildFTSIndexByDatabase(WizDatabase& db);
+    bool buildFTSIndexByDirtyDocuments();
+    bool indexDocuments(WizDatabase& db, CWizDocumentDataArray& arrayDocuments);
     void filterDocuments(WizDatabase& db, CWizDocumentDataArray& arrayDocument,
                          bool searchEncryptedDoc);
-    bool updateDocument(const WIZDOCUMENTDATAEX& doc);
+    bool updateDocument(const WIZDOCUMENTDATAEX& doc, const QString& strPlainText);
     bool deleteDocument(const WIZDOCUMENTDATAEX& doc);
+    bool _updateDocumentImpl(void *pHandle, const WIZDOCUMENTDATAEX& doc,
+                             const QString& strPlainText);
 
-    bool _updateDocumentImpl(void *pHandle, const WIZDOCUMENTDATAEX& doc);
+    // one writer is shared by all documents of an indexing pass
+    void* writerHandle();
+    bool commitWriter();
+    bool closeWriter();
+    void applyPendingDeletions();
+    void markCommittedDocuments(bool bCommitted);
+    void throttle(int nWorkMilliseconds);
 
     Q_INVOKABLE bool rebuildFTSIndex();
     bool clearAllFTSData();
@@ -75,16 +95,50 @@ private:
     bool m_stop;
     bool m_buldNow;
     QMutex m_mutex;
-    QTimer m_timer;
+    QTimer m_timer;         // startup consistency check
     QWaitCondition m_wait;
 
+    // guarded by m_mutex
+    bool m_bFullScan;       // scan all databases for documents not indexed
+    bool m_bDirty;          // dirty documents settled, index them
+    QMap<QString, QString> m_mapDirty;  // document guid -> kb guid
+    QTimer m_timerDirty;    // coalesce saves of the same document
+
+    // batch indexing
+    float m_fRamBufferMB;
+    int m_nMergeFactor;
+    int m_nCommitInterval;  // documents per commit
+    int m_nCpuUsage;        // percent of one core used while system is busy
+    int m_nExtractThreads;
+    IWizThreadPool* m_pExtractPool;   // created on first use, shut down when thread ends
+    void* m_pWriter;
+    QTime m_timeLastCommit;
+    int m_nIndexed;
+    int m_nFailed;          // documents of current pass not indexed
+    int m_nRetryDelay;      // full scan after a pass with failed documents
+    // kb_guid / document guid, flagged as indexed only after they are committed
+    QList<QPair<QString, QString> > m_arrayUncommitted;
+    // guard m_pWriter and deletions requested while writer is opened
+    QMutex m_mutexWriter;
+    QStringList m_listPendingDeleted;
+
 private Q_SLOTS:
+    void on_document_dataModified(const WIZDOCUMENTDATA& doc);
     void on_document_deleted(const WIZDOCUMENTDATA& doc);
     void on_attachment_deleted(const WIZDOCUMENTATTACHMENTDATA& attach);
 };
 
 
 /* ----------------------------- CWizSearcher ----------------------------- */
+struct WIZSEARCHRESULT
+{
+    WIZDOCUMENTDATAEX doc;
+    float fScore;
+    QString strSnippet;     // html, keywords are highlighted by <b>
+};
+
+typedef QList<WIZSEARCHRESULT> CWizSearchResultArray;
+
 class WizSearcher
         : public QThread
         , public WizCluceneSearch
@@ -103,6 +157,10 @@ public:
     void searchByKeywordAndWhere(const QString& strKeywords, const QString& strWhere, int nMaxSize = -1
             , SearchScope scope = Scope_AllNotes);
 
+    // full text search, best nTopK notes first. thread safe, returns synchronously
+    bool searchRanked(const QString& strKeywords, int nTopK, bool bSnippet,
+                      CWizSearchResultArray& arrayResult, SearchScope scope = Scope_AllNotes);
+
 protected:
     virtual bool onSearchProcess(const std::string& lpszKbGUID, const std::string& lpszDocumentID, const std::string& lpszURL);
     virtual bool onSearchEnd();
@@ -121,14 +179,19 @@ private:
     QWaitCondition m_wait;
 
 
-    // guid-document map, search faster
-    QMap<QString, WIZDOCUMENTDATAEX> m_mapDocumentSearched;
+    // in the order found, full text hits are sorted by score
+    CWizDocumentDataArray m_arrayDocumentSearched;
+    QSet<QString> m_setDocumentSearched; // guids of above, search faster
     int m_nResults; // results returned
 
     void doSearch();
+    void addSearchedDocument(const WIZDOCUMENTDATAEX& doc);
+    void clearSearchedDocuments();
 
     Q_INVOKABLE void searchKeyword(const QString& strKeywords);
     void searchDatabaseByKeyword(const QString& strKeywords);
+    bool searchIndexByKeyword(const QString& strKeywords);
+    std::wstring scopeKbGUID(SearchScope scope);
     WizOleDateTime getDateByInterval(SearchDateInterval dateInterval);
 
     void emitSearchProcess(const QString& strKeywords);
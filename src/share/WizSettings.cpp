@@ -160,6 +160,174 @@ CString WizGetShortcut(const CString& strName, const CString& strDef /*= ""*/)
 }
 
 
+WizUserSettingsCache* WizUserSettingsCache::instance()
+{
+    static WizUserSettingsCache* cache = new WizUserSettingsCache();
+    return cache;
+}
+
+QString WizUserSettingsCache::settingKey(const QString& section, const QString& strKey)
+{
+    return section.toUpper() + "/" + strKey.toUpper();
+}
+
+void WizUserSettingsCache::addDatabase(WizDatabase* db)
+{
+    QString strAccountFolderName = db->getAccountFolderName();
+
+    QMutexLocker locker(&m_mutex);
+    if (m_mapDatabase.contains(strAccountFolderName, db))
+        return;
+
+    m_mapDatabase.insert(strAccountFolderName, db);
+
+    // direct, meta may be written by any thread and cache should be updated at once
+    connect(db, &WizIndexBase::metaModified, this, [=](const QString& strMetaName, const QString& strKey, const QString& strValue) {
+        onMetaModified(strAccountFolderName, strMetaName, strKey, strValue);
+    }, Qt::DirectConnection);
+    connect(db, &WizIndexBase::metaDeleted, this, [=](const QString& strMetaName, const QString& strKey) {
+        onMetaDeleted(strAccountFolderName, strMetaName, strKey);
+    }, Qt::DirectConnection);
+}
+
+void WizUserSettingsCache::removeDatabase(WizDatabase* db)
+{
+    disconnect(db, 0, this, 0);
+
+    QMutexLocker locker(&m_mutex);
+    QMultiHash<QString, WizDatabase*>::iterator it = m_mapDatabase.begin();
+    while (it != m_mapDatabase.end()) {
+        if (it.value() == db) {
+            it = m_mapDatabase.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+WizDatabase* WizUserSettingsCache::database(const QString& strAccountFolderName)
+{
+    QMutexLocker locker(&m_mutex);
+    return m_mapDatabase.value(strAccountFolderName, NULL);
+}
+
+bool WizUserSettingsCache::load(const QString& strAccountFolderName, CWizSettingsMap& settings)
+{
+    // not locked, opening database or reading meta may take a while
+    CWizMetaDataArray arrayMeta;
+    if (WizDatabase* db = database(strAccountFolderName)) {
+        if (!db->getMetas(arrayMeta))
+            return false;
+    } else {
+        WizDatabase db;
+        if (!db.open(strAccountFolderName))
+            return false;
+
+        if (!db.getMetas(arrayMeta))
+            return false;
+    }
+
+    for (CWizMetaDataArray::const_iterator it = arrayMeta.begin(); it != arrayMeta.end(); it++) {
+        settings.insert(settingKey(it->strName, it->strKey), it->strValue);
+    }
+
+    return true;
+}
+
+QString WizUserSettingsCache::get(const QString& strAccountFolderName, const QString& section, const QString& strKey)
+{
+    QString strSettingKey = settingKey(section, strKey);
+    quint64 nChanges = 0;
+    {
+        QMutexLocker locker(&m_mutex);
+        QHash<QString, CWizSettingsMap>::const_iterator it = m_mapSettings.constFind(strAccountFolderName);
+        if (it != m_mapSettings.constEnd())
+            return it->value(strSettingKey);
+
+        nChanges = m_nChanges;
+    }
+
+    CWizSettingsMap settings;
+    if (!load(strAccountFolderName, settings))
+        return QString();
+
+    // meta changed while loading may be missed by settings, they are used
+    // once and loaded again next time
+    QMutexLocker locker(&m_mutex);
+    if (nChanges == m_nChanges && !m_mapSettings.contains(strAccountFolderName)) {
+        m_mapSettings.insert(strAccountFolderName, settings);
+    }
+
+    return settings.value(strSettingKey);
+}
+
+void WizUserSettingsCache::set(const QString& strAccountFolderName, const QString& section, const QString& strKey, const QString& strValue)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        QHash<QString, CWizSettingsMap>::const_iterator it = m_mapSettings.find(strAccountFolderName);
+        if (it != m_mapSettings.end() && it->value(settingKey(section, strKey)) == strValue)
+            return;
+    }
+
+    // cache is updated by metaModified of database
+    if (WizDatabase* db = database(strAccountFolderName)) {
+        db->setMeta(section, strKey, strValue);
+        return;
+    }
+
+    WizDatabase db;
+    if (db.open(strAccountFolderName)) {
+        db.setMeta(section, strKey, strValue);
+    }
+}
+
+void WizUserSettingsCache::onMetaModified(const QString& strAccountFolderName, const QString& strMetaName,
+                                          const QString& strKey, const QString& strValue)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_nChanges++;
+        QHash<QString, CWizSettingsMap>::iterator it = m_mapSettings.find(strAccountFolderName);
+        if (it != m_mapSettings.end()) {
+            it->insert(settingKey(strMetaName, strKey), strValue);
+        }
+    }
+
+    Q_EMIT settingChanged(strAccountFolderName, strMetaName, strKey, strValue);
+}
+
+void WizUserSettingsCache::onMetaDeleted(const QString& strAccountFolderName, const QString& strMetaName,
+                                         const QString& strKey)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_nChanges++;
+        QHash<QString, CWizSettingsMap>::iterator it = m_mapSettings.find(strAccountFolderName);
+        if (it == m_mapSettings.end())
+            return;
+
+        if (!strKey.isEmpty()) {
+            it->remove(settingKey(strMetaName, strKey));
+        } else {
+            QString strPrefix = strMetaName.toUpper() + "/";
+            CWizSettingsMap::iterator itKey = it->begin();
+            while (itKey != it->end()) {
+                if (itKey.key().startsWith(strPrefix)) {
+                    itKey = it->erase(itKey);
+                } else {
+                    ++itKey;
+                }
+            }
+        }
+    }
+
+    if (!strKey.isEmpty()) {
+        Q_EMIT settingChanged(strAccountFolderName, strMetaName, strKey, QString());
+    }
+}
+
+
 WizUserSettings::WizUserSettings(const QString& strAccountFolderName)
     : m_strAccountFolderName(strAccountFolderName)
     , m_db(NULL)
@@ -185,13 +353,19 @@ QString WizUserSettings::myWizMail() const
     return get("ACCOUNT", "MYWIZMAIL");
 }
 
+QString WizUserSettings::cacheAccountFolderName() const
+{
+    if (m_db)
+        return m_db->isGroup() ? QString() : m_db->getAccountFolderName();
+
+    return m_strAccountFolderName;
+}
+
 QString WizUserSettings::get(const QString& section, const QString& strKey) const
 {
-    if (!m_strAccountFolderName.isEmpty()) {
-        WizDatabase db;
-        if (db.open(m_strAccountFolderName)) {
-            return db.getMetaDef(section, strKey);
-        }
+    QString strAccountFolderName = cacheAccountFolderName();
+    if (!strAccountFolderName.isEmpty()) {
+        return WizUserSettingsCache::instance()->get(strAccountFolderName, section, strKey);
     }
 
     if (m_db) {
@@ -203,12 +377,10 @@ QString WizUserSettings::get(const QString& section, const QString& strKey) cons
 
 void WizUserSettings::set(const QString& section, const QString& strKey, const QString& strValue)
 {
-    if (!m_strAccountFolderName.isEmpty()) {
-        WizDatabase db;
-        if (db.open(m_strAccountFolderName)) {
-            db.setMeta(section, strKey, strValue);
-            return;
-        }
+    QString strAccountFolderName = cacheAccountFolderName();
+    if (!strAccountFolderName.isEmpty()) {
+        WizUserSettingsCache::instance()->set(strAccountFolderName, section, strKey, strValue);
+        return;
     }
 
     if (m_db) {
@@ -222,94 +394,34 @@ QString WizUserSettings::userId() const
     if (m_db)
         return m_db->getUserId();
 
-    if (!m_strAccountFolderName.isEmpty()) {
-        WizDatabase db;
-        if (db.open(m_strAccountFolderName)) {
-            return db.getUserId();
-        }
-    }
-
-    return QString();
+    // same as user id loaded by database when opened
+    return get("Account", "USERID");
 }
 
 void WizUserSettings::setUserId(const QString& strUserId)
 {
-    if (m_db)
-    {
-        m_db->setMeta("Account", "USERID", strUserId);
-    }
-    else if (!m_strAccountFolderName.isEmpty())
-    {
-        WizDatabase db;
-        if (db.open(m_strAccountFolderName)) {
-            db.setMeta("Account", "USERID", strUserId);
-        }
-    }
+    set("Account", "USERID", strUserId);
 }
 
 QString WizUserSettings::get(const QString& strKey) const
 {
-    if (!m_strAccountFolderName.isEmpty()) {
-        WizDatabase db;
-        if (db.open(m_strAccountFolderName)) {
-            return db.getMetaDef(USER_SETTINGS_SECTION, strKey);
-        }
-    }
-
-    if (m_db) {
-        return m_db->getMetaDef(USER_SETTINGS_SECTION, strKey);
-    }
-
-    return QString();
+    return get(USER_SETTINGS_SECTION, strKey);
 }
 
 void WizUserSettings::set(const QString& strKey, const QString& strValue)
 {
-    if (!m_strAccountFolderName.isEmpty()) {
-        WizDatabase db;
-        if (db.open(m_strAccountFolderName)) {
-            db.setMeta(USER_SETTINGS_SECTION, strKey, strValue);
-            return;
-        }
-    }
-
-    if (m_db) {
-        m_db->setMeta(USER_SETTINGS_SECTION, strKey, strValue);
-        return;
-    }
+    set(USER_SETTINGS_SECTION, strKey, strValue);
 }
 
 QString WizUserSettings::password() const
 {
-    QString strPassword;
-    if (!m_strAccountFolderName.isEmpty()) {
-        WizDatabase db;
-        if (db.open(m_strAccountFolderName)) {
-            strPassword = db.getMetaDef("Account", "Password");
-        }
-    }
-
-    if (m_db) {
-        strPassword = m_db->getMetaDef("Account", "Password");
-    }
-
+    QString strPassword = get("Account", "Password");
     return ::WizDecryptPassword(strPassword);
 }
 
 void WizUserSettings::setPassword(const QString& strPassword /* = NULL */)
 {
-    if (!m_strAccountFolderName.isEmpty()) {
-        WizDatabase db;
-        if (db.open(m_strAccountFolderName)) {
-            db.setMeta("Account", "Password", strPassword);
-            return;
-        }
-    }
-
-    if (m_db) {
-        m_db->setMeta("Account", "Password", strPassword);
-        return;
-    }
+    set("Account", "Password", strPassword);
 }
 
 WizServerType WizUserSettings::serverType() const
@@ -2,6 +2,8 @@
 #define WIZSETTINGS_H
 
 #include <QSettings>
+#include <QHash>
+#include <QMutex>
 
 #include "WizQtHelper.h"
 #include "WizMisc.h"
@@ -82,6 +84,52 @@ enum WizPositionType
     wizPositionRight
 };
 
+/*
+ * Process wide cache of meta table of personal databases, reading a user
+ * setting is a hash lookup instead of opening database or a query.
+ * Personal databases are added when opened and every meta change of them
+ * updates the cache, so it is also right if meta is written directly.
+ */
+class WizUserSettingsCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    static WizUserSettingsCache* instance();
+
+    // called by database when it's opened and closed
+    void addDatabase(WizDatabase* db);
+    void removeDatabase(WizDatabase* db);
+
+    QString get(const QString& strAccountFolderName, const QString& section, const QString& strKey);
+    // write through an opened database of account, database is opened if none
+    void set(const QString& strAccountFolderName, const QString& section, const QString& strKey, const QString& strValue);
+
+Q_SIGNALS:
+    // section and key are upper case
+    void settingChanged(const QString& strAccountFolderName, const QString& section,
+                        const QString& strKey, const QString& strValue);
+
+private:
+    WizUserSettingsCache() : m_mutex(QMutex::Recursive), m_nChanges(0) {}
+
+    typedef QHash<QString, QString> CWizSettingsMap;    // SECTION/KEY -> value
+
+    QMutex m_mutex;
+    QHash<QString, CWizSettingsMap> m_mapSettings;      // account folder name -> settings
+    QMultiHash<QString, WizDatabase*> m_mapDatabase;    // account folder name -> opened database
+    quint64 m_nChanges;     // meta changes of all accounts, a load is dropped if changed meanwhile
+
+    static QString settingKey(const QString& section, const QString& strKey);
+    WizDatabase* database(const QString& strAccountFolderName);
+    bool load(const QString& strAccountFolderName, CWizSettingsMap& settings);
+
+    void onMetaModified(const QString& strAccountFolderName, const QString& strMetaName,
+                        const QString& strKey, const QString& strValue);
+    void onMetaDeleted(const QString& strAccountFolderName, const QString& strMetaName,
+                       const QString& strKey);
+};
+
 class WizUserSettings
 {
 public:
@@ -98,6 +146,9 @@ private:
     QString m_strLocale;
     WizDatabase* m_db;
 
+    // settings of personal database are cached, empty for group database
+    QString cacheAccountFolderName() const;
+
 public:
     QString get(const QString& key) const;
     void set(const QString& key, const QString& value);
@@ -45,6 +45,17 @@ struct IWizSyncableDatabase
                                   const QString& strObjectGUID,
                                   const QString& strObjectType,
                                   const QByteArray& stream) = 0;
+    // file which object data is downloaded to. downloaded parts are kept in
+    // account cache until the object is saved, partial files of other
+    // versions of the object are removed.
+    virtual QString getObjectDownloadFileName(const WIZOBJECTDATA& data) = 0;
+    // data was downloaded to strFileName, the file is moved or removed.
+    // strMD5: md5 of data
+    virtual bool updateObjectDataByFile(const QString& strDisplayName,
+                                        const QString& strObjectGUID,
+                                        const QString& strObjectType,
+                                        const QString& strFileName,
+                                        const QString& strMD5) = 0;
 
     virtual bool isObjectDataDownloaded(const QString& strGUID,
                                         const QString& strType) = 0;
@@ -169,55 +169,36 @@ void CWizThreadPool::clearTasks()
 {
     QMutexLocker lock(&m_cs);
     //
+    // dropped tasks are never run, nobody else will delete them
+    for (IWizRunable* task : m_tasks)
+    {
+        task->destroy();
+    }
     m_tasks.clear();
 }
 
 IWizRunable* CWizThreadPool::peekOne()    //execute on worker
 {
-    if (m_bShuttingDown)
-        return nullptr;
-    //
-    IWizRunable* task = nullptr;
-    //
-    //
-    //
-    {
-        QMutexLocker lock(&m_cs);
-        if (m_bShuttingDown)
-            return nullptr;
-        //
-        if (!m_tasks.empty())
-        {
-            task = *m_tasks.begin();
-            m_tasks.pop_front();
-        }
-    }
-
-    //
-    if (task)
-        return task;
-    //
-    {
-        QMutexLocker locker(&m_csEvent);
-        m_event.wait(&m_csEvent);
-        //
-        if (m_bShuttingDown)
-            return nullptr;
-    }
-    //
-    //
+    // tasks are checked and waited for while holding m_csEvent. addTask and
+    // shutdown wake workers under it too, so a task added between the check
+    // and the wait can't be missed
+    QMutexLocker locker(&m_csEvent);
+    while (!m_bShuttingDown)
     {
-        QMutexLocker lock(&m_cs);
-        //
-        if (!m_tasks.empty())
         {
-            task = *m_tasks.begin();
-            m_tasks.pop_front();
+            QMutexLocker lock(&m_cs);
+            if (!m_tasks.empty())
+            {
+                IWizRunable* task = *m_tasks.begin();
+                m_tasks.pop_front();
+                return task;
+            }
         }
         //
+        m_event.wait(&m_csEvent);
     }
     //
-    return task;
+    return nullptr;
 }
 //
 bool CWizThreadPool::isShuttingDown()
@@ -248,7 +229,10 @@ void CWizThreadPool::shutdown(int timeout)
             if (!thread->IsAlive())
             {
                 m_threads.erase(m_threads.begin() + i);
-                thread->deleteLater();
+                // pool may be shut down by a thread without event loop,
+                // deleteLater would never delete finished workers there
+                thread->wait();
+                delete thread;
             }
             else
             {
@@ -1,6 +1,7 @@
 ﻿#include "WizThumbIndex.h"
 
 #include <QBuffer>
+#include <QPainter>
 #include <QDebug>
 
 #include "WizDef.h"
@@ -168,6 +169,64 @@ bool WizThumbIndex::abstractFromGuid(const CString& guid, WIZABSTRACT &abstract,
 	}
 }
 
+bool WizThumbIndex::padAbstractsFromGuids(const CWizStdStringArray& arrayGuid, std::map<CString, WIZABSTRACT>& mapAbstract)
+{
+    return abstractsFromGuids(arrayGuid, mapAbstract, PAD_TYPE);
+}
+
+bool WizThumbIndex::abstractsFromGuids(const CWizStdStringArray& arrayGuid, std::map<CString, WIZABSTRACT>& mapAbstract, const CString& type)
+{
+    if(!m_dbThumb.isOpened())
+        return false;
+
+    if (arrayGuid.empty())
+        return true;
+
+    CWizStdStringArray arrayGuid2;
+    CWizStdStringArray::const_iterator it;
+    for (it = arrayGuid.begin(); it != arrayGuid.end(); it++) {
+        arrayGuid2.push_back(STR2SQL(*it));
+    }
+
+    CString strText;
+    WizStringArrayToText(arrayGuid2, strText, ",");
+
+    CString sql = CString("select ") + FIELD_LIST_ABSTRACT + " from " + TABLE_NAME_ABSTRACT + " where ABSTRACT_GUID in ("
+                    + strText + (") AND ABSTRACT_TYPE=")
+                    + STR2SQL(type)
+                    + (";");
+    try
+    {
+        CppSQLite3Query query = m_dbThumb.execQuery(sql);
+
+        while (!query.eof())
+        {
+            WIZABSTRACT abstract;
+            abstract.guid = query.getStringField(0);
+            abstract.text = query.getStringField(2);
+            int length;
+            const unsigned char * imageData = query.getBlobField(3, length);
+            if (imageData && length)
+            {
+                abstract.image.loadFromData(imageData, length);
+            }
+            mapAbstract[abstract.guid] = abstract;
+            query.nextRow();
+        }
+        return true;
+    }
+    catch (const CppSQLite3Exception& e)
+    {
+        TOLOG(e.errorMessage());
+        TOLOG(sql);
+        return false;
+    }
+    catch (...) {
+        TOLOG("Unknown exception while query abstracts");
+        return false;
+    }
+}
+
 bool WizThumbIndex::updatePadAbstract(const WIZABSTRACT &abstract)
 {
     return updateAbstract(abstract, PAD_TYPE);
@@ -212,10 +271,20 @@ bool WizThumbIndex::updateAbstract(const WIZABSTRACT &abstractNew, const CString
             TOLOG("Failed to scale image to abstract");
             return false;
         }
+
+        // jpeg has no alpha channel, list view background is white
+        if (img.hasAlphaChannel()) {
+            QImage imgOpaque(img.size(), QImage::Format_RGB32);
+            imgOpaque.fill(Qt::white);
+            QPainter painter(&imgOpaque);
+            painter.drawImage(0, 0, img);
+            painter.end();
+            img = imgOpaque;
+        }
         //
         QBuffer buffer(&data);
         buffer.open(QIODevice::WriteOnly);
-        if (!img.save(&buffer, "PNG"))
+        if (!img.save(&buffer, "JPG", nThumbnailJpegQuality))
         {
             TOLOG("Failed to save abstract image data to buffer");
             return false;
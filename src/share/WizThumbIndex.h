@@ -2,11 +2,13 @@
 #define WIZTHUMBINDEX_H
 
 #include <QImage>
+#include <map>
 
 #include "cppsqlite3.h"
 #include "WizObject.h"
 
 const int nThumbnailPixmapMaxWidth = 50;
+const int nThumbnailJpegQuality = 80;
 
 class WizThumbIndex
 {
@@ -22,6 +24,7 @@ private:
     bool checkThumbTable(const CString& strTableName, const CString& strTableSQL);
     bool updateAbstract(const WIZABSTRACT& abstract, const CString& type);
     bool abstractFromGuid(const CString& guid, WIZABSTRACT& lpszAbstract,const CString& type);
+    bool abstractsFromGuids(const CWizStdStringArray& arrayGuid, std::map<CString, WIZABSTRACT>& mapAbstract, const CString& type);
     bool abstractIsExist(const CString& guid,const CString& type);
 
 public:
@@ -32,6 +35,8 @@ public:
     bool updateIphoneAbstract(const WIZABSTRACT &lpszAbstract);
     bool phoneAbstractFromGuid(const CString& guid, WIZABSTRACT& lpszAbstract);
     bool padAbstractFromGuid(const CString& guid, WIZABSTRACT& lpszAbstract);
+    // load abstracts of many documents with one query, missing ones are not in map
+    bool padAbstractsFromGuids(const CWizStdStringArray& arrayGuid, std::map<CString, WIZABSTRACT>& mapAbstract);
     bool deleteAbstractByGuid(const CString& guid);
     bool phoneAbstractExist(const CString& guid);
     bool padAbstractExist(const CString& guid);
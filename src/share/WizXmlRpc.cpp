@@ -1,6 +1,7 @@
 ﻿#include "WizXmlRpc.h"
 
 #include <QUrl>
+#include <algorithm>
 
 #include "WizMisc.h"
 #include "../utils/WizLogger.h"
@@ -134,6 +135,421 @@ bool WizXmlRpcResultFromXml(WizXMLDocument& doc, WizXmlRpcValue** ppRet)
 }
 
 
+/* ------------------------- CWizXmlRpcStreamReader ------------------------- */
+// bytes added to reader at a time, also the max size of a text piece
+#define WIZXMLRPC_STREAM_BLOCK_SIZE     (64 * 1024)
+
+WizXmlRpcStreamReader::WizXmlRpcStreamReader(const QByteArray& data)
+    : m_data(data)
+    , m_nPos(0)
+{
+    // server may send <ex:nil/> or <ex:i8> without declaring the prefix
+    m_reader.setNamespaceProcessing(false);
+}
+
+QString WizXmlRpcStreamReader::errorString() const
+{
+    return m_strError;
+}
+
+bool WizXmlRpcStreamReader::setError(const QString& strError)
+{
+    if (m_strError.isEmpty())
+    {
+        m_strError = m_reader.hasError() ? m_reader.errorString() : strError;
+    }
+    return false;
+}
+
+QXmlStreamReader::TokenType WizXmlRpcStreamReader::readNext()
+{
+    while (true)
+    {
+        QXmlStreamReader::TokenType type = m_reader.readNext();
+        if (type == QXmlStreamReader::Invalid
+                && m_reader.error() == QXmlStreamReader::PrematureEndOfDocumentError
+                && m_nPos < m_data.size())
+        {
+            int nSize = std::min<int>(WIZXMLRPC_STREAM_BLOCK_SIZE, m_data.size() - m_nPos);
+            m_reader.addData(m_data.mid(m_nPos, nSize));
+            m_nPos += nSize;
+            continue;
+        }
+        //
+        return type;
+    }
+}
+
+// skip white spaces, comments... until next element
+bool WizXmlRpcStreamReader::readStartElement(QString& strName)
+{
+    while (true)
+    {
+        switch (readNext())
+        {
+        case QXmlStreamReader::StartElement:
+            strName = m_reader.name().toString();
+            return true;
+        case QXmlStreamReader::Characters:
+            if (!m_reader.isWhitespace())
+                return setError("Unexpected text: " + m_reader.text().toString());
+            break;
+        case QXmlStreamReader::EndElement:
+            return setError("Unexpected end of element: " + m_reader.name().toString());
+        case QXmlStreamReader::EndDocument:
+        case QXmlStreamReader::Invalid:
+            return setError("Unexpected end of document");
+        default:
+            break;
+        }
+    }
+}
+
+bool WizXmlRpcStreamReader::readStartElement(const QString& strName)
+{
+    QString strElementName;
+    if (!readStartElement(strElementName))
+        return false;
+    //
+    if (0 != strElementName.compare(strName, Qt::CaseInsensitive))
+        return setError(WizFormatString2("Unexpected element: %1, %2 expected", strElementName, strName));
+    //
+    return true;
+}
+
+bool WizXmlRpcStreamReader::readEndElement()
+{
+    while (true)
+    {
+        switch (readNext())
+        {
+        case QXmlStreamReader::EndElement:
+            return true;
+        case QXmlStreamReader::Characters:
+            if (!m_reader.isWhitespace())
+                return setError("Unexpected text: " + m_reader.text().toString());
+            break;
+        case QXmlStreamReader::StartElement:
+            return setError("Unexpected element: " + m_reader.name().toString());
+        case QXmlStreamReader::EndDocument:
+        case QXmlStreamReader::Invalid:
+            return setError("Unexpected end of document");
+        default:
+            break;
+        }
+    }
+}
+
+// text of current element, end element is read
+bool WizXmlRpcStreamReader::readText(QString& strText)
+{
+    strText.clear();
+    while (true)
+    {
+        switch (readNext())
+        {
+        case QXmlStreamReader::Characters:
+            strText.append(m_reader.text());
+            break;
+        case QXmlStreamReader::EndElement:
+            return true;
+        case QXmlStreamReader::StartElement:
+            return setError("Unexpected element: " + m_reader.name().toString());
+        case QXmlStreamReader::EndDocument:
+        case QXmlStreamReader::Invalid:
+            return setError("Unexpected end of document");
+        default:
+            break;
+        }
+    }
+}
+
+bool WizXmlRpcStreamReader::readBase64(QByteArray& arrayData)
+{
+    arrayData.clear();
+    //
+    // characters which can not be decoded until next piece of text
+    QByteArray arrayRest;
+    while (true)
+    {
+        switch (readNext())
+        {
+        case QXmlStreamReader::Characters:
+        {
+            QStringRef text = m_reader.text();
+            QByteArray arrayText = arrayRest;
+            arrayText.reserve(arrayRest.size() + text.size());
+            for (int i = 0; i < text.size(); i++)
+            {
+                QChar ch = text.at(i);
+                if (!ch.isSpace())
+                {
+                    arrayText.append(ch.toLatin1());
+                }
+            }
+            //
+            int nDecode = arrayText.size() / 4 * 4;
+            arrayData.append(QByteArray::fromBase64(QByteArray::fromRawData(arrayText.constData(), nDecode)));
+            arrayRest = arrayText.mid(nDecode);
+            break;
+        }
+        case QXmlStreamReader::EndElement:
+            if (!arrayRest.isEmpty())
+            {
+                arrayData.append(QByteArray::fromBase64(arrayRest));
+            }
+            return true;
+        case QXmlStreamReader::StartElement:
+            return setError("Unexpected element: " + m_reader.name().toString());
+        case QXmlStreamReader::EndDocument:
+        case QXmlStreamReader::Invalid:
+            return setError("Unexpected end of document");
+        default:
+            break;
+        }
+    }
+}
+
+// value element has been read, read value until end of value element
+bool WizXmlRpcStreamReader::readValue(WizXmlRpcValue** ppRet)
+{
+    *ppRet = NULL;
+    //
+    QString strText;
+    QString strValueType;
+    while (strValueType.isEmpty())
+    {
+        switch (readNext())
+        {
+        case QXmlStreamReader::Characters:
+            strText.append(m_reader.text());
+            break;
+        case QXmlStreamReader::StartElement:
+            // with prefix, such as ex:nil
+            strValueType = m_reader.qualifiedName().toString();
+            break;
+        case QXmlStreamReader::EndElement:
+            // value without type
+            *ppRet = new WizXmlRpcStringValue(strText);
+            return true;
+        case QXmlStreamReader::EndDocument:
+        case QXmlStreamReader::Invalid:
+            return setError("Unexpected end of document");
+        default:
+            break;
+        }
+    }
+    //
+    WizXmlRpcValue* pValue = NULL;
+    //
+    if (0 == strValueType.compare("int", Qt::CaseInsensitive)
+        || 0 == strValueType.compare("i4", Qt::CaseInsensitive))
+    {
+        if (!readText(strText))
+            return false;
+        pValue = new WizXmlRpcIntValue(strText.toInt());
+    }
+    else if (0 == strValueType.compare("string", Qt::CaseInsensitive)
+        || 0 == strValueType.compare("ex:nil", Qt::CaseInsensitive)
+        || 0 == strValueType.compare("ex:i8", Qt::CaseInsensitive)
+        || 0 == strValueType.compare("nil", Qt::CaseInsensitive)
+        || 0 == strValueType.compare("i8", Qt::CaseInsensitive))
+    {
+        if (!readText(strText))
+            return false;
+        pValue = new WizXmlRpcStringValue(strText);
+    }
+    else if (0 == strValueType.compare("struct", Qt::CaseInsensitive))
+    {
+        WizXmlRpcStructValue* pStruct = new WizXmlRpcStructValue();
+        pValue = pStruct;
+        if (!readStruct(pStruct))
+        {
+            delete pValue;
+            return false;
+        }
+    }
+    else if (0 == strValueType.compare("array", Qt::CaseInsensitive))
+    {
+        WizXmlRpcArrayValue* pArray = new WizXmlRpcArrayValue();
+        pValue = pArray;
+        if (!readArray(pArray))
+        {
+            delete pValue;
+            return false;
+        }
+    }
+    else if (0 == strValueType.compare("base64", Qt::CaseInsensitive))
+    {
+        QByteArray arrayData;
+        if (!readBase64(arrayData))
+            return false;
+        pValue = new WizXmlRpcBase64Value(arrayData);
+    }
+    else if (0 == strValueType.compare("boolean", Qt::CaseInsensitive)
+        || 0 == strValueType.compare("bool", Qt::CaseInsensitive))
+    {
+        if (!readText(strText))
+            return false;
+        pValue = new WizXmlRpcBoolValue(strText == "1" || 0 == strText.compare("true", Qt::CaseInsensitive));
+    }
+    else if (0 == strValueType.compare("dateTime.iso8601", Qt::CaseInsensitive))
+    {
+        if (!readText(strText))
+            return false;
+        //
+        WizOleDateTime t;
+        CString strError;
+        if (!WizIso8601StringToDateTime(strText, t, strError))
+            return setError(strError);
+        pValue = new WizXmlRpcTimeValue(t);
+    }
+    else
+    {
+        return setError("Unknown xmlrpc value type: " + strValueType);
+    }
+    //
+    Q_ASSERT(pValue);
+    //
+    // end of value element
+    if (!readEndElement())
+    {
+        delete pValue;
+        return false;
+    }
+    //
+    *ppRet = pValue;
+    return true;
+}
+
+bool WizXmlRpcStreamReader::readStruct(WizXmlRpcStructValue* pStruct)
+{
+    while (true)
+    {
+        switch (readNext())
+        {
+        case QXmlStreamReader::StartElement:
+        {
+            if (0 != m_reader.name().compare(QLatin1String("member"), Qt::CaseInsensitive))
+                return setError("Unexpected element in struct: " + m_reader.name().toString());
+            //
+            QString strName;
+            if (!readStartElement("name") || !readText(strName))
+                return false;
+            //
+            WizXmlRpcValue* pMemberValue = NULL;
+            if (!readStartElement("value") || !readValue(&pMemberValue))
+                return false;
+            //
+            pStruct->addValue(strName, pMemberValue);
+            //
+            // end of member element
+            if (!readEndElement())
+                return false;
+            break;
+        }
+        case QXmlStreamReader::Characters:
+            if (!m_reader.isWhitespace())
+                return setError("Unexpected text: " + m_reader.text().toString());
+            break;
+        case QXmlStreamReader::EndElement:
+            return true;
+        case QXmlStreamReader::EndDocument:
+        case QXmlStreamReader::Invalid:
+            return setError("Unexpected end of document");
+        default:
+            break;
+        }
+    }
+}
+
+bool WizXmlRpcStreamReader::readArray(WizXmlRpcArrayValue* pArray)
+{
+    if (!readStartElement("data"))
+        return false;
+    //
+    while (true)
+    {
+        switch (readNext())
+        {
+        case QXmlStreamReader::StartElement:
+        {
+            if (0 != m_reader.name().compare(QLatin1String("value"), Qt::CaseInsensitive))
+                return setError("Unexpected element in array: " + m_reader.name().toString());
+            //
+            WizXmlRpcValue* pElementValue = NULL;
+            if (!readValue(&pElementValue))
+                return false;
+            //
+            pArray->add(pElementValue);
+            break;
+        }
+        case QXmlStreamReader::Characters:
+            if (!m_reader.isWhitespace())
+                return setError("Unexpected text: " + m_reader.text().toString());
+            break;
+        case QXmlStreamReader::EndElement:
+            // end of data and array element
+            return readEndElement();
+        case QXmlStreamReader::EndDocument:
+        case QXmlStreamReader::Invalid:
+            return setError("Unexpected end of document");
+        default:
+            break;
+        }
+    }
+}
+
+bool WizXmlRpcStreamReader::readResult(WizXmlRpcValue** ppRet)
+{
+    *ppRet = NULL;
+    //
+    if (!readStartElement("methodResponse"))
+        return false;
+    //
+    QString strName;
+    if (!readStartElement(strName))
+        return false;
+    //
+    if (0 == strName.compare("params", Qt::CaseInsensitive))
+    {
+        if (!readStartElement("param") || !readStartElement("value"))
+            return false;
+        //
+        return readValue(ppRet);
+    }
+    else if (0 == strName.compare("fault", Qt::CaseInsensitive))
+    {
+        if (!readStartElement("value") || !readStartElement("struct"))
+            return false;
+        //
+        WizXmlRpcFaultValue* pFault = new WizXmlRpcFaultValue();
+        if (!readStruct(&pFault->m_val))
+        {
+            delete pFault;
+            return false;
+        }
+        //
+        *ppRet = pFault;
+        return true;
+    }
+    //
+    return setError("Unknown response node name: " + strName);
+}
+
+bool WizXmlRpcResultFromData(const QByteArray& data, WizXmlRpcValue** ppRet)
+{
+    WizXmlRpcStreamReader reader(data);
+    if (!reader.readResult(ppRet))
+    {
+        TOLOG1("Failed to parse xmlrpc response: %1", reader.errorString());
+        return false;
+    }
+    //
+    return true;
+}
+
+
 /* ------------------------- CWizXmlRpcIntValue ------------------------- */
 WizXmlRpcRequest::WizXmlRpcRequest(const QString& strMethodName)
 {
@@ -1,6 +1,8 @@
 ﻿#ifndef WIZXMLRPC_H
 #define WIZXMLRPC_H
 
+#include <QXmlStreamReader>
+
 #include "WizXml.h"
 
 
@@ -212,6 +214,8 @@ public:
 private:
     std::map<QString, WizXmlRpcValue*> m_map;
 
+    friend class WizXmlRpcStreamReader;
+
     // map management methods
     void clear();
     void removeValue(const QString& strName);
@@ -239,6 +243,8 @@ public:
 
 private:
     WizXmlRpcStructValue m_val;
+
+    friend class WizXmlRpcStreamReader;
 };
 
 
@@ -260,6 +266,40 @@ protected:
 bool WizXmlRpcResultFromXml(WizXMLDocument& doc, WizXmlRpcValue** ppRet);
 
 
+/* ------------------------- CWizXmlRpcStreamReader ------------------------- */
+// Parse response without building dom tree or converting the whole response
+// to QString. Input is fed to the reader in small blocks, so text of a value
+// (base64 data of a part) is reported in pieces, base64 is decoded piece by
+// piece into the value.
+class WizXmlRpcStreamReader
+{
+public:
+    WizXmlRpcStreamReader(const QByteArray& data);
+
+    bool readResult(WizXmlRpcValue** ppRet);
+    QString errorString() const;
+
+private:
+    const QByteArray& m_data;
+    int m_nPos;
+    QXmlStreamReader m_reader;
+    QString m_strError;
+
+    QXmlStreamReader::TokenType readNext();
+    bool readStartElement(const QString& strName);
+    bool readStartElement(QString& strName);
+    bool readEndElement();
+    bool readText(QString& strText);
+    bool readBase64(QByteArray& arrayData);
+    bool readValue(WizXmlRpcValue** ppRet);
+    bool readStruct(WizXmlRpcStructValue* pStruct);
+    bool readArray(WizXmlRpcArrayValue* pArray);
+    bool setError(const QString& strError);
+};
+
+bool WizXmlRpcResultFromData(const QByteArray& data, WizXmlRpcValue** ppRet);
+
+
 // template methods
 
 template <class TData>
@@ -4,6 +4,7 @@
 #include <QDir>
 #include <QFileInfo>
 #include <QFile>
+#include <QBuffer>
 
 #include "quazip/quazip.h"
 #include "quazip/quazipfile.h"
@@ -602,6 +603,7 @@ bool WizZipFile::close()
 
 WizUnzipFile::WizUnzipFile()
     : m_zip(NULL)
+    , m_buffer(NULL)
 {
 
 }
@@ -624,6 +626,27 @@ bool WizUnzipFile::open(const CString& strFileName)
     return m_zip ? true : false;
 }
 
+bool WizUnzipFile::open(const QByteArray& data)
+{
+    close();
+    //
+    m_buffer = new QBuffer();
+    m_buffer->setData(data);
+    //
+    m_zip = new QuaZip(m_buffer);
+    if (!m_zip->open(QuaZip::mdUnzip))
+    {
+        delete m_zip;
+        m_zip = NULL;
+        delete m_buffer;
+        m_buffer = NULL;
+        return false;
+    }
+    //
+    m_names = m_zip->getFileNameList();
+    return true;
+}
+
 int WizUnzipFile::count()
 {
     if (!m_zip)
@@ -650,6 +673,21 @@ int WizUnzipFile::fileNameToIndex(const CString& strNameInZip)
     return m_names.indexOf(strNameInZip);
 }
 
+qint64 WizUnzipFile::fileSize(const CString& strNameInZip)
+{
+    if (!m_zip)
+        return -1;
+    //
+    if (!m_zip->setCurrentFile(strNameInZip))
+        return -1;
+    //
+    QuaZipFileInfo info;
+    if (!m_zip->getCurrentFileInfo(&info))
+        return -1;
+    //
+    return info.uncompressedSize;
+}
+
 bool WizUnzipFile::extractFile(int index, const CString& strFileName)
 {
     if (!m_zip)
@@ -668,6 +706,25 @@ bool WizUnzipFile::extractFile(const CString& strNameInZip, const CString& strFi
     //
     return JlCompress::extractFile(m_zip, strNameInZip, strFileName);
 }
+
+bool WizUnzipFile::extractFileToData(const CString& strNameInZip, QByteArray& data)
+{
+    if (!m_zip)
+        return false;
+    //
+    if (!m_zip->setCurrentFile(strNameInZip))
+        return false;
+    //
+    QuaZipFile inFile(m_zip);
+    if (!inFile.open(QIODevice::ReadOnly) || inFile.getZipError() != UNZ_OK)
+        return false;
+    //
+    data = inFile.readAll();
+    inFile.close();
+    //
+    return inFile.getZipError() == UNZ_OK;
+}
+
 bool WizUnzipFile::extractAll(const CString& strDestPath)
 {
     if (!m_zip)
@@ -697,6 +754,9 @@ bool WizUnzipFile::close()
     //
     m_zip = NULL;
     //
+    delete m_buffer;
+    m_buffer = NULL;
+    //
     return ret;
 }
 
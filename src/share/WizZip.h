@@ -5,6 +5,7 @@
 #include <QStringList>
 
 class QuaZip;
+class QBuffer;
 
 class WizZipFile
 {
@@ -27,14 +28,19 @@ public:
     virtual ~WizUnzipFile();
 protected:
     QuaZip* m_zip;
+    QBuffer* m_buffer;
     QStringList m_names;
 public:
     bool open(const CString& strFileName);
+    // open an archive which is already in memory, eg: decrypted note
+    bool open(const QByteArray& data);
     int count();
     CString fileName(int index);
     int fileNameToIndex(const CString& strNameInZip);
+    qint64 fileSize(const CString& strNameInZip);
     bool extractFile(int index, const CString& strFileName);
     bool extractFile(const CString& strNameInZip, const CString& strFileName);
+    bool extractFileToData(const CString& strNameInZip, QByteArray& data);
     bool extractAll(const CString& strDestPath);
     bool close();
 
@@ -28,6 +28,7 @@
 #include "cppsqlite3.h"
 #include <cstdlib>
 #include <assert.h>
+#include <QThread>
 
 #include "../utils/WizPathResolve.h"
 #include "../utils/WizLogger.h"
@@ -729,16 +730,28 @@ void CppSQLite3Statement::checkVM()
 ////////////////////////////////////////////////////////////////////////////////
 
 CppSQLite3DB::CppSQLite3DB()
+	: mWriterMutex(QMutex::Recursive)
 {
 	mpDB = 0;
 	mnBusyTimeoutMs = 60000; // 60 seconds
+	mnTransactionDepth = 0;
+	mbTransactionFailed = false;
+	mTransactionThread = 0;
+	mbReadOnly = false;
+	mbWal = false;
 }
 
 
 CppSQLite3DB::CppSQLite3DB(const CppSQLite3DB& db)
+	: mWriterMutex(QMutex::Recursive)
 {
 	mpDB = db.mpDB;
 	mnBusyTimeoutMs = 60000; // 60 seconds
+	mnTransactionDepth = 0;
+	mbTransactionFailed = false;
+	mTransactionThread = 0;
+	mbReadOnly = db.mbReadOnly;
+	mbWal = db.mbWal;
 }
 
 
@@ -756,9 +769,17 @@ CppSQLite3DB& CppSQLite3DB::operator=(const CppSQLite3DB& db)
 }
 
 
-void CppSQLite3DB::open(const CString& strFile)
+void CppSQLite3DB::open(const CString& strFile, bool bReadOnly)
 {
-    int nRet = sqlite3_open16(strFile.utf16(), &mpDB);
+    int nRet;
+    if (bReadOnly)
+    {
+        nRet = sqlite3_open_v2(strFile.toUtf8().constData(), &mpDB, SQLITE_OPEN_READONLY, 0);
+    }
+    else
+    {
+        nRet = sqlite3_open16(strFile.utf16(), &mpDB);
+    }
 
 	if (nRet != SQLITE_OK)
 	{
@@ -766,7 +787,42 @@ void CppSQLite3DB::open(const CString& strFile)
         throw CppSQLite3Exception(nRet, szError);
 	}
 
+	mbReadOnly = bReadOnly;
 	setBusyTimeout(mnBusyTimeoutMs);
+	setupPragmas();
+}
+
+void CppSQLite3DB::setupPragmas()
+{
+	// best effort, database works with default settings if any of them fails
+	mbWal = false;
+	try
+	{
+		// journal mode is stored in database file, readers only check it.
+		// wal may be refused, eg: database on network file system
+		CppSQLite3Query query = execQuery(mbReadOnly ? "pragma journal_mode;" : "pragma journal_mode=WAL;");
+		if (!query.eof())
+		{
+			mbWal = (0 == query.getStringField(0).compare("wal", Qt::CaseInsensitive));
+		}
+	}
+	catch (const CppSQLite3Exception& e)
+	{
+		TOLOG1("Failed to set journal mode: %1", e.errorMessage());
+	}
+
+	// full sync is only needed by rollback journal, normal is still
+	// consistent in wal mode, only last commits may be lost on power failure
+	CString strPragma = mbWal ? "pragma synchronous=NORMAL;" : "";
+	// 2000 pages, pages are 1KB by default, mmap is ignored by sqlite before 3.7.17
+	strPragma += "pragma cache_size=2000; pragma temp_store=MEMORY; pragma mmap_size=67108864;";
+
+	char* szError = 0;
+	if (SQLITE_OK != sqlite3_exec(mpDB, strPragma.toUtf8().constData(), 0, 0, &szError))
+	{
+		TOLOG1("Failed to set pragma: %1", CString(szError));
+		sqlite3_free(szError);
+	}
 }
 
 
@@ -774,9 +830,15 @@ void CppSQLite3DB::close()
 {
 	if (mpDB)
 	{
+		// connection can't be closed with unfinalized statements
+		clearStatementCache();
 		sqlite3_close(mpDB);
 		mpDB = 0;
 	}
+	mnTransactionDepth = 0;
+	mbTransactionFailed = false;
+	mTransactionThread.store(0);
+	mbWal = false;
 }
 
 
@@ -800,6 +862,8 @@ int CppSQLite3DB::execDML(const CString& strSQL)
 {
 	checkDB();
 
+	CppSQLite3WriterLocker locker(*this);
+
 	char* szError=0;
     //
     QByteArray utf8 = strSQL.toUtf8();
@@ -868,6 +932,198 @@ void CppSQLite3DB::setBusyTimeout(int nMillisecs)
 	sqlite3_busy_timeout(mpDB, mnBusyTimeoutMs);
 }
 
+void CppSQLite3DB::lockWriter()
+{
+	if (mWriterMutex.tryLock())
+		return;
+
+	// seen by transaction owner, which lets us in between its slices
+	mnWritersWaiting.ref();
+	mWriterMutex.lock();
+	mnWritersWaiting.deref();
+}
+
+void CppSQLite3DB::beginTransaction()
+{
+	// released by commitTransaction or rollbackTransaction, other threads
+	// wait here or in execDML until the outermost transaction ends
+	lockWriter();
+	if (mnTransactionDepth == 0)
+	{
+		try
+		{
+			// take write lock now, instead of failing on the first write
+			execDML("begin immediate transaction;");
+		}
+		catch (const CppSQLite3Exception&)
+		{
+			unlockWriter();
+			throw;
+		}
+		mbTransactionFailed = false;
+		mTransactionTimer.start();
+		mTransactionThread.store(QThread::currentThreadId());
+	}
+	mnTransactionDepth++;
+}
+
+bool CppSQLite3DB::isTransactionOwner() const
+{
+	return mTransactionThread.load() == QThread::currentThreadId();
+}
+
+bool CppSQLite3DB::commitTransaction()
+{
+	if (!isTransactionOwner())
+		return false;
+
+	if (--mnTransactionDepth > 0)
+	{
+		unlockWriter();
+		return true;
+	}
+
+	// flag belongs to next transaction once writer mutex is released
+	bool bFailed = mbTransactionFailed;
+	mTransactionThread.store(0);
+	try
+	{
+		execDML(bFailed ? "rollback transaction;" : "commit transaction;");
+	}
+	catch (const CppSQLite3Exception&)
+	{
+		// transaction is still opened if commit failed
+		sqlite3_exec(mpDB, "rollback transaction;", 0, 0, 0);
+		unlockWriter();
+		throw;
+	}
+	unlockWriter();
+	return !bFailed;
+}
+
+void CppSQLite3DB::rollbackTransaction()
+{
+	if (!isTransactionOwner())
+		return;
+
+	mbTransactionFailed = true;
+	if (--mnTransactionDepth > 0)
+	{
+		unlockWriter();
+		return;
+	}
+
+	mTransactionThread.store(0);
+	try
+	{
+		execDML("rollback transaction;");
+	}
+	catch (const CppSQLite3Exception&)
+	{
+		unlockWriter();
+		throw;
+	}
+	unlockWriter();
+}
+
+bool CppSQLite3DB::yieldTransaction(int nMaxMSecs)
+{
+	// only the outermost transaction of a batch is sliced, a failed one
+	// is rolled back when it ends
+	if (!isTransactionOwner() || mnTransactionDepth != 1 || mbTransactionFailed)
+		return false;
+
+	if (mnWritersWaiting.load() == 0 && mTransactionTimer.elapsed() < nMaxMSecs)
+		return false;
+
+	commitTransaction();
+
+	// mutex is not fair, give waiting writers a moment to take it
+	for (int i = 0; i < 100 && mnWritersWaiting.load() > 0; i++)
+	{
+		QThread::msleep(1);
+	}
+
+	beginTransaction();
+	return true;
+}
+
+sqlite3_stmt* CppSQLite3DB::acquireStatement(const CString& strSQL, bool& bCached)
+{
+	checkDB();
+
+	QMutexLocker locker(&mStatementMutex);
+
+	QHash<QString, CachedStatement>::iterator it = mStatementCache.find(strSQL);
+	if (it != mStatementCache.end())
+	{
+		if (!it->bInUse)
+		{
+			it->bInUse = true;
+			bCached = true;
+			return it->pVM;
+		}
+	}
+
+	// v2 statements are recompiled automatically if schema changed
+	const void* szTail = 0;
+	sqlite3_stmt* pVM = 0;
+	int nRet = sqlite3_prepare16_v2(mpDB, strSQL.utf16(), -1, &pVM, &szTail);
+	if (nRet != SQLITE_OK)
+	{
+		throw CppSQLite3Exception(nRet, sqlite3_errmsg(mpDB));
+	}
+
+	// used by another thread or nested call, this one is not cached
+	if (it != mStatementCache.end())
+	{
+		bCached = false;
+		return pVM;
+	}
+
+	CachedStatement statement;
+	statement.pVM = pVM;
+	statement.bInUse = true;
+	mStatementCache.insert(strSQL, statement);
+
+	bCached = true;
+	return pVM;
+}
+
+void CppSQLite3DB::releaseStatement(const CString& strSQL, sqlite3_stmt* pVM, bool bCached)
+{
+	if (!pVM)
+		return;
+
+	if (!bCached)
+	{
+		sqlite3_finalize(pVM);
+		return;
+	}
+
+	sqlite3_reset(pVM);
+	sqlite3_clear_bindings(pVM);
+
+	QMutexLocker locker(&mStatementMutex);
+	QHash<QString, CachedStatement>::iterator it = mStatementCache.find(strSQL);
+	if (it != mStatementCache.end() && it->pVM == pVM)
+	{
+		it->bInUse = false;
+	}
+}
+
+void CppSQLite3DB::clearStatementCache()
+{
+	QMutexLocker locker(&mStatementMutex);
+
+	QHash<QString, CachedStatement>::iterator it;
+	for (it = mStatementCache.begin(); it != mStatementCache.end(); it++)
+	{
+		sqlite3_finalize(it->pVM);
+	}
+	mStatementCache.clear();
+}
+
 BOOL CppSQLite3DB::isOpened()
 {
     return mpDB ? TRUE : FALSE;
@@ -889,7 +1145,8 @@ sqlite3_stmt* CppSQLite3DB::compile(const CString& strSQL)
     const void* szTail=0;
 	sqlite3_stmt* pVM;
 
-    int nRet = sqlite3_prepare16(mpDB, strSQL, -1, &pVM, &szTail);
+    // v2: recompiled if schema is changed by another connection
+    int nRet = sqlite3_prepare16_v2(mpDB, strSQL, -1, &pVM, &szTail);
 
 	if (nRet != SQLITE_OK)
 	{
@@ -900,11 +1157,98 @@ sqlite3_stmt* CppSQLite3DB::compile(const CString& strSQL)
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+
+CppSQLite3CachedStatement::CppSQLite3CachedStatement(CppSQLite3DB& db, const CString& strSQL)
+	: mDB(db)
+	, mSQL(strSQL)
+	, mpVM(0)
+	, mbCached(false)
+{
+	mpVM = mDB.acquireStatement(mSQL, mbCached);
+}
+
+CppSQLite3CachedStatement::~CppSQLite3CachedStatement()
+{
+	mDB.releaseStatement(mSQL, mpVM, mbCached);
+}
+
+void CppSQLite3CachedStatement::checkBind(int nRes)
+{
+	if (nRes != SQLITE_OK)
+	{
+		throw CppSQLite3Exception(nRes, "Error binding param");
+	}
+}
+
+void CppSQLite3CachedStatement::bind(int nParam, const CString& strValue)
+{
+	if (strValue.isEmpty())
+	{
+		checkBind(sqlite3_bind_null(mpVM, nParam));
+		return;
+	}
+
+	checkBind(sqlite3_bind_text16(mpVM, nParam, strValue.utf16(),
+								  strValue.length() * sizeof(ushort), SQLITE_TRANSIENT));
+}
+
+void CppSQLite3CachedStatement::bind(int nParam, int nValue)
+{
+	checkBind(sqlite3_bind_int(mpVM, nParam, nValue));
+}
+
+void CppSQLite3CachedStatement::bind(int nParam, __int64 nValue)
+{
+	checkBind(sqlite3_bind_int64(mpVM, nParam, nValue));
+}
+
+void CppSQLite3CachedStatement::bind(int nParam, const WizOleDateTime& t)
+{
+	bind(nParam, WizDateTimeToString(t));
+}
+
+int CppSQLite3CachedStatement::execDML()
+{
+	CppSQLite3WriterLocker locker(mDB);
+
+	int nRet = sqlite3_step(mpVM);
+	if (nRet != SQLITE_DONE)
+	{
+		sqlite3_reset(mpVM);
+		throw CppSQLite3Exception(nRet, sqlite3_errmsg(mDB.handle()));
+	}
+
+	int nRowsChanged = sqlite3_changes(mDB.handle());
+	sqlite3_reset(mpVM);
+	return nRowsChanged;
+}
+
+CppSQLite3Query CppSQLite3CachedStatement::execQuery()
+{
+	int nRet = sqlite3_step(mpVM);
+	if (nRet == SQLITE_DONE)
+	{
+		return CppSQLite3Query(mDB.handle(), mpVM, true/*eof*/, false);
+	}
+	else if (nRet == SQLITE_ROW)
+	{
+		return CppSQLite3Query(mDB.handle(), mpVM, false/*eof*/, false);
+	}
+
+	sqlite3_reset(mpVM);
+	throw CppSQLite3Exception(nRet, sqlite3_errmsg(mDB.handle()));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 int CppSQLite3DB::updateBlob(const CString& szTableName, const CString& szFieldName, const unsigned char* data, int dataLength, const CString& szWhere)
 {
 
     CString sql = CString("update ") + szTableName + " set " + szFieldName + "=? where " + szWhere;
 
+    CppSQLite3WriterLocker locker(*this);
+
     CppSQLite3Statement statement = compileStatement(sql);
     statement.bind(1, data, dataLength);
 
@@ -913,6 +1257,8 @@ int CppSQLite3DB::updateBlob(const CString& szTableName, const CString& szFieldN
 
 int CppSQLite3DB::insertBlob(const CString& szSQL, const unsigned char *data, int dataLength)
 {
+    CppSQLite3WriterLocker locker(*this);
+
     CppSQLite3Statement statement = compileStatement(szSQL);
 
     statement.bind(1, data, dataLength);
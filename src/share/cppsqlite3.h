@@ -31,6 +31,11 @@
 #include "sqlite3.h"
 #include <cstdio>
 #include <cstring>
+#include <QHash>
+#include <QMutex>
+#include <QAtomicPointer>
+#include <QAtomicInt>
+#include <QElapsedTimer>
 #include "WizMisc.h"
 
 #define CPPSQLITE_ERROR 1000
@@ -178,10 +183,14 @@ public:
 
     virtual ~CppSQLite3DB();
 
-    void open(const CString& strFile);
+    // read only connections are used for queries beside the writing one,
+    // they don't block each other when database is in wal mode.
+    void open(const CString& strFile, bool bReadOnly = false);
 
     void close();
 
+    bool isWalEnabled() const { return mbWal; }
+
     bool tableExists(const CString& strTable);
 
     int execDML(const CString& strSQL);
@@ -198,6 +207,28 @@ public:
 
     void setBusyTimeout(int nMillisecs);
 
+    // nested transactions are merged into the outermost one, rollback of an
+    // inner one rolls back everything when the outermost one ends.
+    // connection is shared by threads, writes of other threads wait until
+    // the transaction ends instead of being made in it.
+    void beginTransaction();
+    // false if outermost transaction is rolled back because a nested one was
+    bool commitTransaction();
+    void rollbackTransaction();
+    // commit a long batch in slices: if outermost transaction is older than
+    // nMaxMSecs or other threads are waiting to write, it is committed and
+    // begun again after them. returns false if nothing was done
+    bool yieldTransaction(int nMaxMSecs);
+    bool inTransaction() const { return mTransactionThread.load() != 0; }
+    // transaction is begun by current thread, its reads should use this connection
+    bool isTransactionOwner() const;
+
+    // statements compiled once per connection, see CppSQLite3CachedStatement.
+    // bCached is false if the cached one is being used, caller got a new one.
+    sqlite3_stmt* acquireStatement(const CString& strSQL, bool& bCached);
+    void releaseStatement(const CString& strSQL, sqlite3_stmt* pVM, bool bCached);
+    sqlite3* handle() const { return mpDB; }
+
     static const char* SQLiteVersion() { return SQLITE_VERSION; }
 	//
     BOOL isOpened();
@@ -209,6 +240,9 @@ public:
 
 private:
 
+    friend class CppSQLite3CachedStatement;
+    friend class CppSQLite3WriterLocker;
+
     CppSQLite3DB(const CppSQLite3DB& db);
     CppSQLite3DB& operator=(const CppSQLite3DB& db);
 
@@ -218,11 +252,88 @@ private:
 
     sqlite3* mpDB;
     int mnBusyTimeoutMs;
+    // held by a writer, for the whole transaction if one is begun.
+    // depth, failed flag and timer are only used by the thread holding it.
+    QMutex mWriterMutex;
+    QAtomicInt mnWritersWaiting;
+    int mnTransactionDepth;
+    bool mbTransactionFailed;
+    QElapsedTimer mTransactionTimer;
+    QAtomicPointer<void> mTransactionThread;
+
+    void lockWriter();
+    void unlockWriter() { mWriterMutex.unlock(); }
+
+    bool mbReadOnly;
+    bool mbWal;
+
+    void setupPragmas();
+
+    struct CachedStatement
+    {
+        sqlite3_stmt* pVM;
+        bool bInUse;
+    };
+    // sql template -> compiled statement, connection is shared by threads
+    QHash<QString, CachedStatement> mStatementCache;
+    QMutex mStatementMutex;
+
+    void clearStatementCache();
 	//
     bool dump(const CString& strNewFileName);
     bool read(const CString& strNewFileName);
 };
 
+/*
+ * Compiled statement taken from connection cache, parameters are bound by
+ * index (1 based) instead of being formatted and escaped into sql text.
+ * Statement is reset and returned to the cache when this goes out of scope.
+ */
+class CppSQLite3CachedStatement
+{
+public:
+    CppSQLite3CachedStatement(CppSQLite3DB& db, const CString& strSQL);
+    ~CppSQLite3CachedStatement();
+
+    // empty string is bound as NULL, same as STR2SQL
+    void bind(int nParam, const CString& strValue);
+    void bind(int nParam, int nValue);
+    void bind(int nParam, __int64 nValue);
+    void bind(int nParam, const WizOleDateTime& t);
+
+    int execDML();
+    // rows are valid until this statement is destroyed
+    CppSQLite3Query execQuery();
+
+private:
+    CppSQLite3CachedStatement(const CppSQLite3CachedStatement&);
+    CppSQLite3CachedStatement& operator=(const CppSQLite3CachedStatement&);
+
+    void checkBind(int nRes);
+
+    CppSQLite3DB& mDB;
+    CString mSQL;
+    sqlite3_stmt* mpVM;
+    bool mbCached;
+};
+
+/*
+ * Holds writer mutex of connection, same as a write or a transaction does.
+ * Other locks needed by a write should be taken after this.
+ */
+class CppSQLite3WriterLocker
+{
+public:
+    explicit CppSQLite3WriterLocker(CppSQLite3DB& db) : mDB(db) { mDB.lockWriter(); }
+    ~CppSQLite3WriterLocker() { mDB.unlockWriter(); }
+
+private:
+    CppSQLite3WriterLocker(const CppSQLite3WriterLocker&);
+    CppSQLite3WriterLocker& operator=(const CppSQLite3WriterLocker&);
+
+    CppSQLite3DB& mDB;
+};
+
 #define STR2SQL(x)		WizStringToSQL(x)
 #define TIME2SQL(x)		WizTimeToSQL(x)
 #define COLOR2SQL(x)	WizColorToSQL(x)
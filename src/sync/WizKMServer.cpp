@@ -5,9 +5,43 @@
 #include "rapidjson/writer.h"
 #include "rapidjson/stringbuffer.h"
 
+#include <QFile>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QCryptographicHash>
+
 #define WIZUSERMESSAGE_AT		0
 #define WIZUSERMESSAGE_EDIT		1
 
+// size of data.download / data.upload parts. it is adjusted by measured
+// throughput, so that one part takes about WIZKM_DATA_PART_MSECONDS
+#define WIZKM_DATA_PART_SIZE_DEFAULT    (500 * 1000)
+#define WIZKM_DATA_PART_SIZE_MIN        (128 * 1024)
+#define WIZKM_DATA_PART_SIZE_MAX        (8 * 1024 * 1024)
+#define WIZKM_DATA_PART_MSECONDS        2000
+
+// shared by all servers, a server object only lives for one sync
+static QAtomicInt g_nDataPartSize(WIZKM_DATA_PART_SIZE_DEFAULT);
+
+static int WizKMGetDataPartSize()
+{
+    return g_nDataPartSize.load();
+}
+
+static void WizKMUpdateDataPartSize(int nPartSize, qint64 nMSeconds)
+{
+    // short parts are mostly request overhead
+    if (nPartSize < WIZKM_DATA_PART_SIZE_MIN)
+        return;
+    //
+    qint64 nSize = qint64(nPartSize) * WIZKM_DATA_PART_MSECONDS / std::max<qint64>(nMSeconds, 1);
+    // grow slowly, shrink at once when network becomes slow
+    nSize = std::min<qint64>(nSize, qint64(g_nDataPartSize.load()) * 2);
+    nSize = qBound<qint64>(WIZKM_DATA_PART_SIZE_MIN, nSize, WIZKM_DATA_PART_SIZE_MAX);
+    //
+    g_nDataPartSize.store(int(nSize));
+}
+
 
 
 WizKMXmlRpcServerBase::WizKMXmlRpcServerBase(const QString& strUrl, QObject* parent)
@@ -701,6 +735,7 @@ bool WizKMAccountsServer::accounts_getMessagesByJson(int nCountPerPage, __int64
 WizKMDatabaseServer::WizKMDatabaseServer(const WIZUSERINFOBASE& kbInfo, QObject* parent)
     : WizKMXmlRpcServerBase(kbInfo.strDatabaseServer, parent)
     , m_userInfo(kbInfo)
+    , m_pStop(NULL)
 {
 }
 WizKMDatabaseServer::~WizKMDatabaseServer()
@@ -1002,12 +1037,17 @@ bool WizKMDatabaseServer::data_upload(const QString& strObjectGUID, const QStrin
     //
     CWizKMDataUploadParam param(m_userInfo.strToken, m_userInfo.strKbGUID, strObjectGUID, strObjectType, strObjectMD5, allSize, partCount, partIndex, stream);
     //
+    QElapsedTimer timer;
+    timer.start();
+    //
     if (!call("data.upload", &param))
     {
         TOLOG("Can not upload object part data!");
         return FALSE;
     }
     //
+    WizKMUpdateDataPartSize(partSize, timer.elapsed());
+    //
     return TRUE;
 }
 
@@ -1020,7 +1060,10 @@ bool WizKMDatabaseServer::data_download(const QString& strObjectGUID, const QStr
     int startPos = 0;
     while (1)
     {
-        int partSize = 500 * 1000;
+        int partSize = WizKMGetDataPartSize();
+        //
+        QElapsedTimer timer;
+        timer.start();
         //
         bool bEOF = FALSE;
         if (!data_download(strObjectGUID, strObjectType, startPos, partSize, stream, nAllSize, bEOF))
@@ -1031,6 +1074,11 @@ bool WizKMDatabaseServer::data_download(const QString& strObjectGUID, const QStr
         //
         int nDownloadedSize = stream.size();
         //
+        if (!bEOF)
+        {
+            WizKMUpdateDataPartSize(nDownloadedSize - startPos, timer.elapsed());
+        }
+        //
         if (bEOF)
             break;
         //
@@ -1048,6 +1096,131 @@ bool WizKMDatabaseServer::data_download(const QString& strObjectGUID, const QStr
     //
     return TRUE;
 }
+bool WizKMDatabaseServer::data_download(const QString& strObjectGUID, const QString& strObjectType, const QString& strFileName, QString& strMD5, const QString& strDisplayName, const QString& strObjectMD5 /* = QString() */)
+{
+    QString strPartFileName = strFileName + ".part";
+    QFile file(strPartFileName);
+    if (!file.open(QFile::ReadWrite))
+    {
+        TOLOG1("Can not create file: %1", strPartFileName);
+        return FALSE;
+    }
+    //
+    // parts downloaded last time are kept in file, every part is verified
+    // before it is written, so the file size is the confirmed offset
+    QCryptographicHash md5(QCryptographicHash::Md5);
+    if (!md5.addData(&file))
+    {
+        TOLOG1("Can not read file: %1", strPartFileName);
+        file.close();
+        file.remove();
+        return FALSE;
+    }
+    //
+    int nDownloadedSize = int(file.size());
+    bool bResumed = nDownloadedSize > 0;
+    if (bResumed)
+    {
+        TOLOG2("Resume downloading object data: %1, pos=%2", strDisplayName, WizIntToStr(nDownloadedSize));
+    }
+    //
+    int nAllSize = 0;
+    while (1)
+    {
+        if (m_pStop && m_pStop->load())
+        {
+            TOLOG1("Stop downloading object data: %1", strDisplayName);
+            return FALSE;
+        }
+        //
+        int partSize = WizKMGetDataPartSize();
+        //
+        QElapsedTimer timer;
+        timer.start();
+        //
+        // only one part is kept in memory
+        QByteArray stream;
+        bool bEOF = FALSE;
+        if (!data_download(strObjectGUID, strObjectType, nDownloadedSize, partSize, stream, nAllSize, bEOF))
+        {
+            // keep downloaded parts, download will be resumed next time
+            TOLOG(WizFormatString1("Failed to download object part data: %1", strDisplayName));
+            return FALSE;
+        }
+        //
+        if (nDownloadedSize + stream.size() > nAllSize)
+        {
+            // object was changed, parts of file belong to another version
+            TOLOG1("Downloaded parts are invalid, restart: %1", strDisplayName);
+            file.resize(0);
+            md5.reset();
+            nDownloadedSize = 0;
+            bResumed = false;
+            continue;
+        }
+        //
+        if (!bEOF)
+        {
+            WizKMUpdateDataPartSize(stream.size(), timer.elapsed());
+        }
+        //
+        if (file.write(stream) != stream.size() || !file.flush())
+        {
+            TOLOG1("Can not write file: %1", strPartFileName);
+            file.close();
+            file.remove();
+            return FALSE;
+        }
+        //
+        md5.addData(stream);
+        nDownloadedSize += stream.size();
+        //
+        if (bEOF)
+        {
+            strMD5 = QString::fromLatin1(md5.result().toHex());
+            if (bResumed && !strObjectMD5.isEmpty() && 0 != strObjectMD5.compare(strMD5, Qt::CaseInsensitive))
+            {
+                // parts kept from last time are broken, download all of it once more
+                TOLOG1("Resumed object data md5 does not match, restart: %1", strDisplayName);
+                file.resize(0);
+                md5.reset();
+                nDownloadedSize = 0;
+                bResumed = false;
+                continue;
+            }
+            break;
+        }
+        //
+        emit downloadProgress(nAllSize, nDownloadedSize);
+    }
+    //
+    file.close();
+    //
+    if (nDownloadedSize != nAllSize)
+    {
+        TOLOG3("Failed to download object data: %1, stream_size=%2, object_size=%3", strDisplayName, WizIntToStr(nDownloadedSize), WizIntToStr(nAllSize));
+        file.remove();
+        return FALSE;
+    }
+    //
+    // not resumed next time, the part file would be broken again
+    if (!strObjectMD5.isEmpty() && 0 != strObjectMD5.compare(strMD5, Qt::CaseInsensitive))
+    {
+        TOLOG2("Downloaded object data md5 does not match: %1, %2", strDisplayName, strMD5);
+        file.remove();
+        return FALSE;
+    }
+    //
+    // readers never see a partial object file
+    if (!::WizReplaceFile(strPartFileName, strFileName))
+    {
+        TOLOG2("Can not rename file %1 to %2", strPartFileName, strFileName);
+        file.remove();
+        return FALSE;
+    }
+    //
+    return TRUE;
+}
 bool WizKMDatabaseServer::data_upload(const QString& strObjectGUID, const QString& strObjectType, const QByteArray& stream, const QString& strObjMD5, const QString& strDisplayName)
 {
     __int64 nStreamSize = stream.size();
@@ -1061,7 +1234,8 @@ bool WizKMDatabaseServer::data_upload(const QString& strObjectGUID, const QStrin
     //
     QByteArray spPartStream;
     //
-    int partSize = 500 * 1000;
+    // part_count is sent with every part, so size is fixed for this object
+    int partSize = WizKMGetDataPartSize();
     int partCount = int(nStreamSize / partSize);
     if (nStreamSize % partSize != 0)
     {
@@ -1,6 +1,8 @@
 ﻿#ifndef WIZKMXMLRPC_H
 #define WIZKMXMLRPC_H
 
+#include <QAtomicInt>
+
 #include "WizXmlRpcServer.h"
 #include "WizJSONServerBase.h"
 #include "share/WizMessageBox.h"
@@ -174,11 +176,14 @@ public:
 protected:
     WIZUSERINFOBASE m_userInfo;
     WIZKBINFO m_kbInfo;
+    const QAtomicInt* m_pStop;
 
 public:
     QString getToken() const { return m_userInfo.strToken; }
     QString getKbGuid() const { return m_userInfo.strKbGUID; }
     int getMaxFileSize() const { return m_kbInfo.getMaxFileSize(); }
+    // data_download stops between parts once *pStop is set
+    void setStopFlag(const QAtomicInt* pStop) { m_pStop = pStop; }
 
     bool wiz_getInfo();
     bool wiz_getVersion(WIZOBJECTVERSION& version, bool bAuto = FALSE);
@@ -207,6 +212,12 @@ public:
     bool category_getAll(QString& str);
 
     bool data_download(const QString& strObjectGUID, const QString& strObjectType, QByteArray& stream, const QString& strDisplayName);
+    // parts are written to strFileName.part, which is renamed to strFileName
+    // when all parts are downloaded. strMD5 is md5 of object data.
+    // if strFileName.part exists, download is resumed from end of it.
+    // if strObjectMD5 is not empty, data that does not match it is removed,
+    // a resumed download is restarted from the beginning once.
+    bool data_download(const QString& strObjectGUID, const QString& strObjectType, const QString& strFileName, QString& strMD5, const QString& strDisplayName, const QString& strObjectMD5 = QString());
     bool data_upload(const QString& strObjectGUID, const QString& strObjectType, const QByteArray& stream, const QString& strObjMD5, const QString& strDisplayName);
     //
     bool getValueVersion(const QString& strKey, __int64& nVersion);
@@ -336,6 +336,8 @@ bool WizKMSyncThread::quickSync()
     //
     Q_UNUSED(helper);
     //
+    // groups are synced together after personal notes
+    CWizGroupDataArray arrayGroup;
     QString kbGuid;
     while (peekQuickSyncKb(kbGuid))
     {
@@ -356,28 +358,19 @@ bool WizKMSyncThread::quickSync()
             WIZGROUPDATA group;
             if (m_db.getGroupData(kbGuid, group))
             {
-                IWizSyncableDatabase* pGroupDatabase = m_db.getGroupDatabase(group);
-                //
-                WIZUSERINFO userInfo = m_info;
-                userInfo.strKbGUID = group.strGroupGUID;
-                userInfo.strDatabaseServer = group.strDatabaseServer;
-                if (userInfo.strDatabaseServer.isEmpty())
-                {
-                    userInfo.strDatabaseServer = WizCommonApiEntry::kUrlFromGuid(userInfo.strToken, userInfo.strKbGUID);
-                }
-                //
-                WizKMSync syncGroup(pGroupDatabase, userInfo, m_pEvents, TRUE, TRUE, NULL);
-                //
-                if (syncGroup.sync())
-                {
-                    pGroupDatabase->saveLastSyncTime();
-                }
-                //
-                m_db.closeGroupDatabase(pGroupDatabase);
+                arrayGroup.push_back(group);
             }
         }
     }
     //
+    if (!arrayGroup.empty())
+    {
+        if (!prepareToken())
+            return false;
+        //
+        ::WizSyncGroups(m_info, m_pEvents, &m_db, arrayGroup, TRUE);
+    }
+    //
     //
     return true;
 }
@@ -2,6 +2,12 @@
 #include "WizKMSync_p.h"
 
 #include <QString>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <QSemaphore>
+#include <deque>
+#include <functional>
 
 #include "utils/WizPathResolve.h"
 #include "WizApiEntry.h"
@@ -11,10 +17,20 @@
 #include "share/WizSyncableDatabase.h"
 #include "share/WizAnalyzer.h"
 #include "share/WizEventLoop.h"
+#include "share/WizThreads.h"
 
 #define IDS_BIZ_SERVICE_EXPR    "Your {p} business service has expired."
 #define IDS_BIZ_NOTE_COUNT_LIMIT     QObject::tr("Group notes count limit exceeded!")
 
+// objects downloaded at the same time, each one is a sequence of data.download calls
+#define WIZKMSYNC_DOWNLOAD_OBJECT_CONCURRENCY   4
+// data.download connections of all databases synced at the same time
+#define WIZKMSYNC_MAX_DOWNLOAD_CONNECTIONS      8
+// groups synced at the same time
+#define WIZKMSYNC_GROUP_CONCURRENCY             4
+// a group which failed to sync is retried in background after 1, 2, 4... minutes
+#define WIZKMSYNC_GROUP_MAX_BACKOFF_MINUTES     60
+
 void GetSyncProgressRange(WizKMSyncProgress progress, int& start, int& count)
 {
     int data[syncDownloadObjectData - syncAccountLogin + 1] = {
@@ -986,6 +1002,86 @@ bool WizCompareObjectByTypeAndTime(const WIZOBJECTDATA& data1, const WIZOBJECTDA
     return data1.tTime > data2.tTime;
 }
 
+// downloaded bytes of objects which are downloading by workers, used to
+// report progress of objects which are not finished yet.
+class WizKMObjectDownloadProgress
+{
+public:
+    void setObjectProgress(const QString& strObjectGUID, int nAllSize, int nDownloadedSize)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_mapObject[strObjectGUID] = qMakePair(nAllSize, nDownloadedSize);
+    }
+    void removeObject(const QString& strObjectGUID)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_mapObject.remove(strObjectGUID);
+    }
+    // sum of finished parts of objects, 0 to count of objects
+    double downloadingObjects()
+    {
+        QMutexLocker locker(&m_mutex);
+        double fCount = 0;
+        QMap<QString, QPair<int, int> >::const_iterator it;
+        for (it = m_mapObject.begin(); it != m_mapObject.end(); it++) {
+            if (it.value().first > 0) {
+                fCount += qMin<double>(1, it.value().second / double(it.value().first));
+            }
+        }
+        return fCount;
+    }
+
+private:
+    QMutex m_mutex;
+    QMap<QString, QPair<int, int> > m_mapObject;   // all size, downloaded size
+};
+
+static QSemaphore& WizKMSyncDownloadConnections()
+{
+    static QSemaphore connections(WIZKMSYNC_MAX_DOWNLOAD_CONNECTIONS);
+    return connections;
+}
+
+struct WIZKMOBJECTDOWNLOADRESULT
+{
+    WIZOBJECTDATA data;
+    bool bDownloaded;
+    QString strFileName;    // object data is downloaded to this file
+    QString strMD5;
+};
+
+// results of workers waiting to be processed by sync thread, which is the
+// only database writer
+template <class TResult>
+class WizKMSyncResults
+{
+public:
+    void push(const TResult& result)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_results.push_back(result);
+        m_wait.wakeAll();
+    }
+    bool pop(TResult& result, unsigned long nTimeout)
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_results.empty()) {
+            m_wait.wait(&m_mutex, nTimeout);
+            if (m_results.empty())
+                return false;
+        }
+
+        result = m_results.front();
+        m_results.pop_front();
+        return true;
+    }
+
+private:
+    QMutex m_mutex;
+    QWaitCondition m_wait;
+    std::deque<TResult> m_results;
+};
+
 bool WizKMSync::downloadObjectData()
 {
     CWizObjectDataArray arrayObject;
@@ -1011,41 +1107,129 @@ bool WizKMSync::downloadObjectData()
     size_t succeeded = 0;
     //
     size_t nCount = arrayObject.size();
-    for (size_t i = 0; i < nCount; i++)
+    //
+    // objects are downloaded by workers in order of priority, at most
+    // nWorkers objects at the same time. data is saved on this thread.
+    // groups are synced at the same time, connections are shared by all of them
+    QSemaphore& connections = WizKMSyncDownloadConnections();
+    while (!connections.tryAcquire(1, 200))
     {
         if (m_pEvents->isStop())
             return FALSE;
+    }
+    //
+    int nWorkers = 1;
+    while (nWorkers < std::min<int>(WIZKMSYNC_DOWNLOAD_OBJECT_CONCURRENCY, total)
+           && connections.tryAcquire(1))
+    {
+        nWorkers++;
+    }
+    //
+    IWizThreadPool* pool = WizCreateThreadPool(nWorkers);
+    //
+    WizKMObjectDownloadProgress progress;
+    WizKMSyncResults<WIZKMOBJECTDOWNLOADRESULT> results;
+    QAtomicInt nStop(0);
+    WIZUSERINFOBASE info = m_info;
+    //
+    size_t nNext = 0;
+    size_t nFinished = 0;
+    int nRunning = 0;
+    while (nFinished < nCount)
+    {
+        if (m_pEvents->isStop())
+            nStop.store(1);
         //
-        WIZOBJECTDATA data = arrayObject[i];
+        while (!nStop.load() && nNext < nCount && nRunning < nWorkers)
+        {
+            WIZOBJECTDATA data = arrayObject[nNext];
+            nNext++;
+            nRunning++;
+            //
+            // parts downloaded by a stopped or failed sync are resumed
+            QString strFileName = m_pDatabase->getObjectDownloadFileName(data);
+            //
+            // md5 of attachment is md5 of extracted file, it's checked by updateObjectDataByFile
+            QString strObjectMD5;
+            WIZDOCUMENTDATA document;
+            if (data.eObjectType == wizobjectDocument && m_pDatabase->documentFromGuid(data.strObjectGUID, document))
+            {
+                strObjectMD5 = document.strDataMD5;
+            }
+            //
+            QString strMsgFormat = data.eObjectType == wizobjectDocument ? _TR("Downloading note: %1"): _TR("Downloading attachment: %1");
+            QString strStatus = WizFormatString1(strMsgFormat, data.strDisplayName);
+            m_pEvents->onStatus(strStatus);
+            //
+            pool->addTask(WizCreateRunable([=, &progress, &results, &nStop]() {
+                WIZKMOBJECTDOWNLOADRESULT result;
+                result.data = data;
+                result.bDownloaded = false;
+                result.strFileName = strFileName;
+                //
+                if (!nStop.load())
+                {
+                    // network objects of server belong to this worker thread
+                    WizKMDatabaseServer server(info);
+                    server.setStopFlag(&nStop);
+                    QObject::connect(&server, &WizKMDatabaseServer::downloadProgress, [&](int nAllSize, int nDownloadedSize) {
+                        progress.setObjectProgress(data.strObjectGUID, nAllSize, nDownloadedSize);
+                    });
+                    //
+                    result.bDownloaded = server.data_download(data.strObjectGUID, WIZOBJECTDATA::objectTypeToTypeString(data.eObjectType), result.strFileName, result.strMD5, data.strDisplayName, strObjectMD5);
+                }
+                //
+                progress.removeObject(data.strObjectGUID);
+                results.push(result);
+            }));
+        }
+        //
+        if (nRunning == 0)
+            break;      // stopped
         //
-        QString strMsgFormat = data.eObjectType == wizobjectDocument ? _TR("Downloading note: %1"): _TR("Downloading attachment: %1");
-        QString strStatus = WizFormatString1(strMsgFormat, data.strDisplayName);
-        m_pEvents->onStatus(strStatus);
+        if (nStop.load())
+        {
+            // queued objects are dropped, running ones stop between parts and
+            // are waited for by shutdown. their parts are kept for next time
+            pool->clearTasks();
+            break;
+        }
         //
-        QByteArray stream;
-        if (m_server.data_download(data.strObjectGUID, WIZOBJECTDATA::objectTypeToTypeString(data.eObjectType), stream, data.strDisplayName))
+        WIZKMOBJECTDOWNLOADRESULT result;
+        if (results.pop(result, 200))
         {
-            if (m_pDatabase->updateObjectData(data.strDisplayName, data.strObjectGUID, WIZOBJECTDATA::objectTypeToTypeString(data.eObjectType), stream))
+            nRunning--;
+            nFinished++;
+            //
+            const WIZOBJECTDATA& data = result.data;
+            if (result.bDownloaded)
             {
-                succeeded++;
+                if (m_pDatabase->updateObjectDataByFile(data.strDisplayName, data.strObjectGUID, WIZOBJECTDATA::objectTypeToTypeString(data.eObjectType), result.strFileName, result.strMD5))
+                {
+                    succeeded++;
+                }
+                else
+                {
+                    m_pEvents->onError(WizFormatString1("Cannot save object data to local: %1!", data.strDisplayName));
+                }
             }
-            else
+            else if (!nStop.load())
             {
-                m_pEvents->onError(WizFormatString1("Cannot save object data to local: %1!", data.strDisplayName));
+                m_pEvents->onError(WizFormatString1("Cannot download object data from server: %1", data.strDisplayName));
             }
         }
-        else
-        {
-            m_pEvents->onError(WizFormatString1("Cannot download object data from server: %1", data.strDisplayName));
-        }
-        //
         //
-        int index = (int)i;
-        //
-        double fPos = index / double(total) * size;
+        double fPos = (nFinished + progress.downloadingObjects()) / double(total) * size;
         m_pEvents->onSyncProgress(start + int(fPos));
     }
     //
+    // waits for running tasks, pool deletes itself and its workers
+    pool->shutdown(0);
+    connections.release(nWorkers);
+    //
+    if (nStop.load())
+        return FALSE;
+    //
     return succeeded == nCount;
 }
 
@@ -1390,6 +1574,201 @@ void syncGroupUsers(WizKMAccountsServer& server, const CWizGroupDataArray& array
     pDatabase->setMeta("SYNC_INFO", "DownloadGroupUsers", QDateTime::currentDateTime().toString());
 }
 
+// state of groups kept between syncs: when the group was opened by user, and
+// when a group which failed to sync can be synced again in background
+class WizKMSyncGroupState
+{
+public:
+    static WizKMSyncGroupState& instance()
+    {
+        static WizKMSyncGroupState state;
+        return state;
+    }
+    //
+    void setOpened(const QString& strKbGUID)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_mapOpened[strKbGUID] = QDateTime::currentMSecsSinceEpoch();
+    }
+    qint64 openedTime(const QString& strKbGUID)
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_mapOpened.value(strKbGUID, 0);
+    }
+    bool isBackoff(const QString& strKbGUID, QDateTime& tRetry)
+    {
+        QMutexLocker locker(&m_mutex);
+        QMap<QString, WIZBACKOFF>::const_iterator it = m_mapBackoff.find(strKbGUID);
+        if (it == m_mapBackoff.end())
+            return false;
+        //
+        tRetry = it.value().tRetry;
+        return tRetry > QDateTime::currentDateTime();
+    }
+    void setSyncResult(const QString& strKbGUID, bool bSucceeded)
+    {
+        QMutexLocker locker(&m_mutex);
+        if (bSucceeded)
+        {
+            m_mapBackoff.remove(strKbGUID);
+            return;
+        }
+        //
+        WIZBACKOFF& backoff = m_mapBackoff[strKbGUID];
+        backoff.nFailed++;
+        int nMinutes = std::min<int>(WIZKMSYNC_GROUP_MAX_BACKOFF_MINUTES, 1 << std::min<int>(backoff.nFailed - 1, 6));
+        backoff.tRetry = QDateTime::currentDateTime().addSecs(nMinutes * 60);
+    }
+
+private:
+    struct WIZBACKOFF
+    {
+        WIZBACKOFF() : nFailed(0) {}
+        int nFailed;
+        QDateTime tRetry;
+    };
+    //
+    QMutex m_mutex;
+    QMap<QString, qint64> m_mapOpened;
+    QMap<QString, WIZBACKOFF> m_mapBackoff;
+};
+
+void WizSyncSetKbOpened(const QString& strKbGUID)
+{
+    WizKMSyncGroupState::instance().setOpened(strKbGUID);
+}
+
+// runs on worker thread, group database is not used by other workers
+typedef std::function<bool(IWizSyncableDatabase* pGroupDatabase, const WIZUSERINFO& userInfo)> WizKMSyncGroupFunction;
+// runs on sync thread after group is synced
+typedef std::function<void(IWizSyncableDatabase* pGroupDatabase, const WIZGROUPDATA& group, bool bSucceeded)> WizKMSyncGroupDoneFunction;
+
+struct WIZKMSYNCGROUPRESULT
+{
+    int nIndex;
+    IWizSyncableDatabase* pGroupDatabase;
+    bool bSucceeded;
+    bool bSkipped;      // stopped before group sync was started
+};
+
+// sync groups on WIZKMSYNC_GROUP_CONCURRENCY workers, recently opened groups
+// first. groups failed recently are skipped in background sync.
+static bool WizSyncGroupsCore(const WIZUSERINFO& info, IWizKMSyncEvents* pEvents,
+                              IWizSyncableDatabase* pDatabase, const CWizGroupDataArray& arrayGroup, bool bBackground,
+                              WizKMSyncGroupFunction funSync, WizKMSyncGroupDoneFunction funDone)
+{
+    if (arrayGroup.empty())
+        return TRUE;
+    //
+    WizKMSyncGroupState& state = WizKMSyncGroupState::instance();
+    //
+    std::vector<int> arrayIndex;
+    for (int i = 0; i < int(arrayGroup.size()); i++)
+    {
+        arrayIndex.push_back(i);
+    }
+    std::stable_sort(arrayIndex.begin(), arrayIndex.end(), [&](int a, int b) {
+        return state.openedTime(arrayGroup[a].strGroupGUID) > state.openedTime(arrayGroup[b].strGroupGUID);
+    });
+    //
+    int nWorkers = std::min<int>(WIZKMSYNC_GROUP_CONCURRENCY, int(arrayGroup.size()));
+    IWizThreadPool* pool = WizCreateThreadPool(nWorkers);
+    WizKMSyncResults<WIZKMSYNCGROUPRESULT> results;
+    //
+    int nRunning = 0;
+    auto processResult = [&](unsigned long nTimeout) {
+        WIZKMSYNCGROUPRESULT result;
+        if (!results.pop(result, nTimeout))
+            return;
+        //
+        nRunning--;
+        if (!result.bSkipped)
+        {
+            funDone(result.pGroupDatabase, arrayGroup[result.nIndex], result.bSucceeded);
+        }
+        pDatabase->closeGroupDatabase(result.pGroupDatabase);
+    };
+    //
+    for (int nIndex : arrayIndex)
+    {
+        if (pEvents->isStop())
+            break;
+        //
+        const WIZGROUPDATA& group = arrayGroup[nIndex];
+        //
+        QDateTime tRetry;
+        if (bBackground && state.isBackoff(group.strGroupGUID, tRetry))
+        {
+            pEvents->onStatus(WizFormatString2(QObject::tr("Skip group %1, retry after %2"), group.strGroupName, tRetry.toString()));
+            continue;
+        }
+        //
+        IWizSyncableDatabase* pGroupDatabase = pDatabase->getGroupDatabase(group);
+        if (!pGroupDatabase)
+        {
+            pEvents->onError(WizFormatString1(QObject::tr("Cannot open group: %1"), group.strGroupName));
+            continue;
+        }
+        //
+        WIZUSERINFO userInfo = info;
+        userInfo.strKbGUID = group.strGroupGUID;
+        userInfo.strDatabaseServer = group.strDatabaseServer;
+        if (userInfo.strDatabaseServer.isEmpty())
+        {
+            userInfo.strDatabaseServer = WizCommonApiEntry::kUrlFromGuid(userInfo.strToken, userInfo.strKbGUID);
+        }
+        //
+        while (nRunning >= nWorkers)
+        {
+            processResult(200);
+        }
+        //
+        pEvents->setCurrentDatabase(1 + nIndex);
+        pEvents->onStatus(WizFormatString1(QObject::tr("----------Sync group: %1----------"), group.strGroupName));
+        //
+        nRunning++;
+        pool->addTask(WizCreateRunable([=, &results]() {
+            WIZKMSYNCGROUPRESULT result;
+            result.nIndex = nIndex;
+            result.pGroupDatabase = pGroupDatabase;
+            // queued groups are finished at once after stop, so their
+            // databases are still closed by this thread
+            result.bSkipped = pEvents->isStop();
+            result.bSucceeded = !result.bSkipped && funSync(pGroupDatabase, userInfo);
+            results.push(result);
+        }));
+    }
+    //
+    // every task pushes one result, running groups check stop themselves
+    while (nRunning > 0)
+    {
+        processResult(200);
+    }
+    //
+    // all posted tasks are finished, pool deletes itself and its workers.
+    // called by sync thread, which has no event loop to delete them later
+    pool->shutdown(0);
+    //
+    return !pEvents->isStop();
+}
+
+bool WizSyncGroups(const WIZUSERINFO& info, IWizKMSyncEvents* pEvents,
+                   IWizSyncableDatabase* pDatabase, const CWizGroupDataArray& arrayGroup, bool bUploadOnly)
+{
+    return WizSyncGroupsCore(info, pEvents, pDatabase, arrayGroup, FALSE,
+                             [=](IWizSyncableDatabase* pGroupDatabase, const WIZUSERINFO& userInfo) {
+        WizKMSync syncGroup(pGroupDatabase, userInfo, pEvents, TRUE, bUploadOnly, NULL);
+        return syncGroup.sync();
+    },
+    [=](IWizSyncableDatabase* pGroupDatabase, const WIZGROUPDATA& group, bool bSucceeded) {
+        WizKMSyncGroupState::instance().setSyncResult(group.strGroupGUID, bSucceeded);
+        if (bSucceeded)
+        {
+            pGroupDatabase->saveLastSyncTime();
+        }
+    });
+}
+
 bool WizSyncDatabase(const WIZUSERINFO& info, IWizKMSyncEvents* pEvents,
                      IWizSyncableDatabase* pDatabase, bool bBackground)
 {
@@ -1510,35 +1889,15 @@ bool WizSyncDatabase(const WIZUSERINFO& info, IWizKMSyncEvents* pEvents,
 
     pEvents->onStatus(QObject::tr("----------sync groups----------"));
     //
-    for (CWizGroupDataArray::const_iterator itGroup = arrayGroup.begin();
-        itGroup != arrayGroup.end();
-        itGroup++)
-    {
-        pEvents->setCurrentDatabase(1 + int(itGroup - arrayGroup.begin()));
-        //
-        if (pEvents->isStop())
-            return FALSE;
-        //
-        WIZGROUPDATA group = *itGroup;
-        //
-        pEvents->onSyncProgress(0);
-        pEvents->onStatus(WizFormatString1(QObject::tr("----------Sync group: %1----------"), group.strGroupName));
-        //
-        IWizSyncableDatabase* pGroupDatabase = pDatabase->getGroupDatabase(group);
-        if (!pGroupDatabase)
-        {
-            pEvents->onError(WizFormatString1(QObject::tr("Cannot open group: %1"), group.strGroupName));
-            continue;
-        }
-        //
-        WIZUSERINFO userInfo = server.m_userInfo;
-        userInfo.strDatabaseServer = group.strDatabaseServer;
-        userInfo.strKbGUID = group.strGroupGUID;
-        //
-        //
+    WizSyncGroupsCore(server.m_userInfo, pEvents, pDatabase, arrayGroup, bBackground,
+                      [=](IWizSyncableDatabase* pGroupDatabase, const WIZUSERINFO& userInfo) {
         WizKMSync syncGroup(pGroupDatabase, userInfo, pEvents, TRUE, FALSE, NULL);
+        return syncGroup.sync();
+    },
+    [=](IWizSyncableDatabase* pGroupDatabase, const WIZGROUPDATA& group, bool bSucceeded) {
+        WizKMSyncGroupState::instance().setSyncResult(group.strGroupGUID, bSucceeded);
         //
-        if (syncGroup.sync())
+        if (bSucceeded)
         {
             pGroupDatabase->clearLastSyncError();
             pGroupDatabase->saveLastSyncTime();
@@ -1548,16 +1907,17 @@ bool WizSyncDatabase(const WIZUSERINFO& info, IWizKMSyncEvents* pEvents,
             if (!group.isBiz())
             {
                 WizSyncPersonalGroupAvatar(pGroupDatabase);
-            }            
+            }
         }
         else
         {
             pEvents->onError(WizFormatString1(QObject::tr("Cannot sync group %1"), group.strGroupName));
             pEvents->onSyncProgress(100);
         }
-        //
-        pDatabase->closeGroupDatabase(pGroupDatabase);
-    }
+    });
+    //
+    if (pEvents->isStop())
+        return FALSE;
     //
     //
     pEvents->onStatus(QObject::tr("----------Downloading notes----------"));
@@ -1580,45 +1940,24 @@ bool WizSyncDatabase(const WIZUSERINFO& info, IWizKMSyncEvents* pEvents,
     if (pEvents->isStop())
         return FALSE;
     //
-    for (CWizGroupDataArray::const_iterator itGroup = arrayGroup.begin();
-        itGroup != arrayGroup.end();
-        itGroup++)
-    {
-        pEvents->setCurrentDatabase(1 + int(itGroup - arrayGroup.begin()));
-        //
-        if (pEvents->isStop())
-            return FALSE;
-        //
-        WIZGROUPDATA group = *itGroup;
-        //
-        //
-        IWizSyncableDatabase* pGroupDatabase = pDatabase->getGroupDatabase(group);
-        if (!pGroupDatabase)
-        {
-            pEvents->onError(WizFormatString1(QObject::tr("Cannot open group: %1"), group.strGroupName));
-            continue;
-        }
-        //
-        WIZUSERINFO userInfo = server.m_userInfo;
-        userInfo.strDatabaseServer = group.strDatabaseServer;
-        userInfo.strKbGUID = group.strGroupGUID;
-        //
-        //
+    WizSyncGroupsCore(server.m_userInfo, pEvents, pDatabase, arrayGroup, bBackground,
+                      [=](IWizSyncableDatabase* pGroupDatabase, const WIZUSERINFO& userInfo) {
         WizKMSync syncGroup(pGroupDatabase, userInfo, pEvents, TRUE, FALSE, NULL);
-        //
-        if (syncGroup.downloadObjectData())
+        return syncGroup.downloadObjectData();
+    },
+    [=](IWizSyncableDatabase* pGroupDatabase, const WIZGROUPDATA& group, bool bSucceeded) {
+        if (bSucceeded)
         {
             pGroupDatabase->saveLastSyncTime();
-            //pEvents->OnStatus(WizFormatString1(_TR("Sync group %1 done"), group.strGroupName));
         }
         else
         {
             pEvents->onError(WizFormatString1(QObject::tr("Cannot sync group %1"), group.strGroupName));
-            //pEvents->OnSyncProgress(100);
         }
-        //
-        pDatabase->closeGroupDatabase(pGroupDatabase);
-    }
+    });
+    //
+    if (pEvents->isStop())
+        return FALSE;
     //
     pEvents->onStatus(QObject::tr("----------Sync done----------"));
     //
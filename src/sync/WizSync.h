@@ -11,4 +11,13 @@ bool WizQuickDownloadMessage(const WIZUSERINFO& info,
                              IWizKMSyncEvents* pEvents,
                              IWizSyncableDatabase* pDatabase);
 
+// sync several groups at the same time, recently opened groups first
+bool WizSyncGroups(const WIZUSERINFO& info,
+                   IWizKMSyncEvents* pEvents,
+                   IWizSyncableDatabase* pDatabase,
+                   const CWizGroupDataArray& arrayGroup, bool bUploadOnly);
+
+// groups opened by user recently are synced before other groups, thread safe
+void WizSyncSetKbOpened(const QString& strKbGUID);
+
 #endif // WIZSERVICE_SYNC_H
@@ -75,18 +75,10 @@ bool WizXmlRpcServerBase::xmlRpcCall(const QString& strMethodName, WizXmlRpcResu
             return false;
         }
         //
-        QString strXml = QString::fromUtf8(loop.result().constData());
-        //
-        WizXMLDocument doc;
-        if (!doc.loadXML(strXml)) {
-            m_nLastErrorCode = -1;
-            m_strLastErrorMessage = "Invalid xml";
-            return false;
-        }
-
+        // parse reply data directly, no dom tree or string copy of the reply
         WizXmlRpcValue* pRet = NULL;
 
-        if (!WizXmlRpcResultFromXml(doc, &pRet)) {
+        if (!WizXmlRpcResultFromData(loop.result(), &pRet)) {
             m_nLastErrorCode = -1;
             m_strLastErrorMessage = "Can not parse xmlrpc";
             return false;